@@ -0,0 +1,66 @@
+#!/bin/bash
+#
+# Measure the round trip latency of native code calling bash functions, by
+# sorting integers with qsort.
+#
+
+source "$(dirname "$0")/harness.sh"
+
+declare -i comparisons
+
+function compare {
+    local -a x=(int) y=(int)
+
+    unpack $2 x
+    unpack $3 y
+
+    comparisons+=1
+
+    if ((${x##*:} < ${y##*:})); then
+        result=(int:-1)
+    elif ((${x##*:} > ${y##*:})); then
+        result=(int:1)
+    else
+        result=(int:0)
+    fi
+
+    pack $1 result
+    return
+}
+
+callback -n compare compare int pointer pointer
+
+for count in 16 256 1024; do
+    declare -a ints=()
+
+    for ((i = 0; i < count; i++)); do
+        ints[i]=int:$RANDOM
+    done
+
+    dlcall -n ptr -r pointer calloc $count 4
+    pack $ptr ints
+
+    comparisons=0
+    start=$EPOCHREALTIME
+    dlcall qsort $ptr long:$count long:4 $compare
+    end=$EPOCHREALTIME
+
+    bench_result qsort.$count.total $(awk -v start=$start -v end=$end \
+        'BEGIN { printf "%.0f", (end - start) * 1000000 }') "us"
+    bench_result qsort.$count.roundtrip $(awk -v n=$comparisons -v start=$start -v end=$end \
+        'BEGIN { printf "%.0f", (end - start) * 1000000000 / n }') "ns"
+
+    dlcall free $ptr
+done
+
+# An empty callback, to separate the cost of the trampoline from unpack.
+function noop {
+    return
+}
+
+callback -n noop noop int pointer pointer
+dlcall -n ptr -r pointer calloc 1024 4
+
+bench_time qsort.1024.noop dlcall qsort $ptr long:1024 long:4 $noop
+
+dlcall free $ptr
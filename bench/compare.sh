@@ -0,0 +1,23 @@
+#!/bin/bash
+#
+# Compare two sets of benchmark results, e.g. from different commits.
+#
+# usage: bench/compare.sh before.tsv after.tsv
+#
+
+if (($# != 2)); then
+    echo "usage: $0 before.tsv after.tsv" 1>&2
+    exit 1
+fi
+
+awk -F '\t' '
+    /^#/            { next }
+    FNR == NR       { before[$1] = $2; next }
+    $1 in before    {
+        # Throughput should go up, latency should go down.
+        change = before[$1] ? ($2 - before[$1]) * 100 / before[$1] : 0
+        better = $3 == "ops/sec" ? change : -change
+        printf "%-40s %14s %14s %-8s %+7.1f%%%s\n", $1, before[$1], $2, $3, change,
+            better < -10 ? "  <- regression" : ""
+    }
+' "$1" "$2"
@@ -0,0 +1,37 @@
+#!/bin/bash
+#
+# Measure dlcall throughput for signatures with zero to six parameters, and
+# the cost of resolving symbols with dlsym.
+#
+
+source "$(dirname "$0")/harness.sh"
+
+# Allocate everything up front, string parameters are copied by every call.
+dlcall -n buf -r pointer calloc 1 64
+dlcall -n fmt1 -r pointer strdup string:%d
+dlcall -n fmt2 -r pointer strdup string:%d%d
+dlcall -n fmt3 -r pointer strdup string:%d%d%d
+
+bench_ops args0     100000 dlcall -r int getpid
+bench_ops args1     100000 dlcall -r long labs long:-1
+bench_ops args2     100000 dlcall -r long strnlen $buf long:64
+bench_ops args3     100000 dlcall -r pointer memchr $buf int:1 long:64
+bench_ops args4     100000 dlcall -r int snprintf $NULL long:0 $fmt1 int:1
+bench_ops args5     100000 dlcall -r int snprintf $NULL long:0 $fmt2 int:1 int:2
+bench_ops args6     100000 dlcall -r int snprintf $NULL long:0 $fmt3 int:1 int:2 int:3
+
+# The same calls with no result, so nothing is bound.
+bench_ops void0     100000 dlcall getpid
+bench_ops void6     100000 dlcall snprintf $NULL long:0 $fmt3 int:1 int:2 int:3
+
+# A prepared builtin skips option parsing and symbol lookup.
+dlbind -r long -n bound_labs labs long
+bench_ops bound1    100000 bound_labs -1
+
+bench_ops dlsym     100000 dlsym -n sym strlen
+bench_ops dlsym.missing 20000 dlsym -n sym __no_such_symbol__ 2> /dev/null
+
+dlcall free $buf
+dlcall free $fmt1
+dlcall free $fmt2
+dlcall free $fmt3
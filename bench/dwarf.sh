@@ -0,0 +1,53 @@
+#!/bin/bash
+#
+# Measure the DWARF loader against test/large.so, which has thousands of
+# compilation units, see test/gendwarf.sh. Every lookup is made in a new
+# shell, so nothing is cached.
+#
+
+source "$(dirname "$0")/harness.sh"
+
+if ! type -t struct > /dev/null; then
+    echo "struct support is not available, skipping" 1>&2
+    exit 0
+fi
+
+large=$(dirname "$0")/../test/large.so
+
+if [[ ! -e $large ]]; then
+    echo "$large does not exist, run make -C test large.so" 1>&2
+    exit 1
+fi
+
+# Run a command in a new shell with the library loaded.
+function cold ()
+{
+    bash -c 'source ctypes.sh
+             dlopen "$1" > /dev/null
+             shift
+             "$@" > /dev/null' cold "$large" "$@"
+}
+
+# Like cold, but print the peak resident set size in kilobytes.
+function peak ()
+{
+    bash -c 'source ctypes.sh
+             dlopen "$1" > /dev/null
+             shift
+             "$@" > /dev/null
+             awk "/^VmHWM/ { print \$2 }" /proc/$$/status' peak "$large" "$@"
+}
+
+# The baseline, loading the library without any lookups.
+bench_time load.cold            cold true
+
+bench_time struct.first.cold    cold struct cu0_leaf s
+bench_time struct.last.cold     cold struct lasttype s
+bench_time struct.common.cold   cold struct common_header s
+bench_time sizeof.first.cold    cold sizeof cu0_leaf
+bench_time sizeof.last.cold     cold sizeof lasttype
+bench_time struct.missing.cold  cold struct __no_such_type__ s 2> /dev/null
+
+# Peak memory, compared to just loading the library.
+bench_result load.peakrss           $(peak true) "kB"
+bench_result struct.last.peakrss    $(peak struct lasttype s) "kB"
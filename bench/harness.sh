@@ -0,0 +1,65 @@
+#!/bin/bash
+#
+# Common routines for benchmarks, source this from a benchmark script.
+#
+# Results are printed one per line as tab separated fields, so that they can
+# be compared across commits with compare.sh:
+#
+#   benchmark   value   unit
+#
+
+source ctypes.sh
+
+# Scale the number of iterations, e.g. BENCH_SCALE=10 for more stable numbers.
+declare -i BENCH_SCALE=${BENCH_SCALE:-1}
+
+# The name of the current suite, prefixed to every result.
+declare BENCH_SUITE=${BENCH_SUITE:-$(basename "$0" .sh)}
+
+# Print a result.
+function bench_result ()
+{
+    printf "%s.%s\t%s\t%s\n" "$BENCH_SUITE" "$1" "$2" "$3"
+}
+
+# Run a command iterations times, and report operations per second.
+#
+#   bench_ops name iterations command [args...]
+#
+function bench_ops ()
+{
+    local name=$1
+    local -i iterations=$(($2 * BENCH_SCALE))
+    local -i i
+    local start end
+
+    shift 2
+
+    start=$EPOCHREALTIME
+    for ((i = 0; i < iterations; i++)); do
+        "$@"
+    done
+    end=$EPOCHREALTIME
+
+    bench_result "$name" $(awk -v n=$iterations -v start=$start -v end=$end \
+        'BEGIN { printf "%.0f", n / (end - start) }') "ops/sec"
+}
+
+# Run a command once, and report how long it took.
+#
+#   bench_time name command [args...]
+#
+function bench_time ()
+{
+    local name=$1
+    local start end
+
+    shift
+
+    start=$EPOCHREALTIME
+    "$@"
+    end=$EPOCHREALTIME
+
+    bench_result "$name" $(awk -v start=$start -v end=$end \
+        'BEGIN { printf "%.0f", (end - start) * 1000000 }') "us"
+}
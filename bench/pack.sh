@@ -0,0 +1,27 @@
+#!/bin/bash
+#
+# Measure pack and unpack throughput across array sizes and element types.
+#
+
+source "$(dirname "$0")/harness.sh"
+
+for type in uint8 int int64 double pointer; do
+    for count in 1 16 256 4096; do
+        declare -a data=()
+
+        for ((i = 0; i < count; i++)); do
+            data[i]=$type:1
+        done
+
+        # Keep the total number of elements roughly constant.
+        iterations=$((65536 / count))
+        iterations=$((iterations > 20000 ? 20000 : iterations))
+
+        dlcall -n ptr -r pointer calloc $count 8
+
+        bench_ops $type.$count.pack      $iterations pack $ptr data
+        bench_ops $type.$count.unpack    $iterations unpack $ptr data
+
+        dlcall free $ptr
+    done
+done
@@ -0,0 +1,20 @@
+#!/bin/bash
+#
+# Run every benchmark, printing tab separated results.
+#
+# usage: bench/run.sh [suite...]
+#
+
+cd "$(dirname "$0")"
+
+suites=("$@")
+
+if ((${#suites[@]} == 0)); then
+    suites=(dlcall stubs pack callback struct dwarf)
+fi
+
+printf "# %s %s\n" "$(git describe --always --dirty 2> /dev/null || echo unknown)" "$(date -u +%FT%TZ)"
+
+for suite in "${suites[@]}"; do
+    bash $suite.sh || exit 1
+done
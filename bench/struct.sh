@@ -0,0 +1,34 @@
+#!/bin/bash
+#
+# Measure struct and sizeof latency with a cold cache, i.e. the first lookup
+# in a new shell, and warm, i.e. repeated lookups. Types from libc and from
+# test/structs.so are used.
+#
+
+source "$(dirname "$0")/harness.sh"
+
+if ! type -t struct > /dev/null; then
+    echo "struct support is not available, skipping" 1>&2
+    exit 0
+fi
+
+structs=$(dirname "$0")/../test/structs.so
+
+# Run a lookup once in a fresh shell.
+function cold ()
+{
+    bash -c 'source ctypes.sh; dlopen "$1" > /dev/null; shift; "$@"' cold "$structs" "$@"
+}
+
+bench_time struct.stat.cold         cold struct stat s
+bench_time sizeof.stat.cold         cold sizeof stat > /dev/null
+bench_ops  struct.stat.warm     100 struct stat s
+bench_ops  sizeof.stat.warm     100 sizeof stat > /dev/null
+
+if [[ -e $structs ]]; then
+    dlopen "$structs" > /dev/null
+
+    bench_time struct.manytypes.cold        cold struct manytypes s
+    bench_ops  struct.manytypes.warm    100 struct manytypes s
+    bench_ops  sizeof.manytypes.warm    100 sizeof manytypes > /dev/null
+fi
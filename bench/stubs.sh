@@ -0,0 +1,14 @@
+#!/bin/bash
+#
+# Compare calls dispatched through specialized stubs with the generic libffi
+# path, which dlcall -F forces.
+#
+
+source "$(dirname "$0")/harness.sh"
+
+bench_ops labs.stub                 100000 dlcall -r long labs long:-1
+bench_ops labs.libffi               100000 dlcall -F -r long labs long:-1
+bench_ops strtol.stub               100000 dlcall -r long strtol string:1234 $NULL int:10
+bench_ops strtol.libffi             100000 dlcall -F -r long strtol string:1234 $NULL int:10
+bench_ops snprintf.stub             100000 dlcall -r int snprintf $NULL long:0 string:%d%d%d int:1 int:2 int:3
+bench_ops snprintf.libffi           100000 dlcall -F -r int snprintf $NULL long:0 string:%d%d%d int:1 int:2 int:3
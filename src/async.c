@@ -0,0 +1,419 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include <ffi.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "common.h"
+#include "bashgetopt.h"
+#include "util.h"
+#include "types.h"
+#include "call.h"
+#include "shell.h"
+
+// The default number of native threads servicing dlcall -A, this can be
+// overridden by setting DLWORKERS before the first asynchronous call.
+#define DEFAULT_WORKERS 4
+#define MAX_WORKERS 64
+
+// An asynchronous call that has been submitted but not yet collected.
+struct job {
+    unsigned long id;
+    struct foreign_call call;
+    char *resultname;
+    bool complete;
+    struct job *next;       // Next outstanding job.
+    struct job *queued;     // Next job waiting for a worker.
+};
+
+// All of the state below is protected by lock. The jobs list is only modified
+// by the shell thread, but workers update the complete flag.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pending = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t completed = PTHREAD_COND_INITIALIZER;
+static struct job *queuehead;
+static struct job **queuetail = &queuehead;
+static struct job *jobs;
+static unsigned long nextid = 1;
+static unsigned nworkers;
+
+// Every completed job writes a newline to this pipe, so that
+// scripts can poll() or select() for completion alongside other fds.
+static int notify[2] = { -1, -1 };
+
+static void * async_worker(void *unused)
+{
+    struct job *job;
+
+    while (true) {
+        pthread_mutex_lock(&lock);
+
+        while (queuehead == NULL)
+            pthread_cond_wait(&pending, &lock);
+
+        job = queuehead;
+
+        if ((queuehead = job->queued) == NULL)
+            queuetail = &queuehead;
+
+        pthread_mutex_unlock(&lock);
+
+        foreign_call_invoke(&job->call);
+
+        // Signal the fd first, so that anyone who sees the job marked as
+        // complete is guaranteed to find the byte waiting.
+        while (write(notify[1], "\n", 1) == -1 && errno == EINTR)
+            ;
+
+        pthread_mutex_lock(&lock);
+        job->complete = true;
+        pthread_cond_broadcast(&completed);
+        pthread_mutex_unlock(&lock);
+    }
+
+    return NULL;
+}
+
+// The workers are not inherited by subshells, so none of the outstanding jobs
+// can complete there. The child starts with no jobs, and creates a new pool
+// and notification pipe if it makes an asynchronous call.
+static void prepare_fork(void)
+{
+    pthread_mutex_lock(&lock);
+}
+
+static void parent_fork(void)
+{
+    pthread_mutex_unlock(&lock);
+}
+
+static void child_fork(void)
+{
+    struct job *job;
+
+    while ((job = jobs)) {
+        jobs = job->next;
+        foreign_call_release(&job->call);
+        free(job->resultname);
+        free(job);
+    }
+
+    if (notify[0] != -1) {
+        close(notify[0]);
+        close(notify[1]);
+    }
+
+    notify[0]   = notify[1] = -1;
+    queuehead   = NULL;
+    queuetail   = &queuehead;
+    nworkers    = 0;
+
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&pending, NULL);
+    pthread_cond_init(&completed, NULL);
+}
+
+// Start the worker pool, this happens on the first asynchronous call.
+static bool start_worker_pool(void)
+{
+    static bool registered;
+
+    sigset_t blocked, saved;
+    unsigned long count;
+    pthread_t thread;
+    char fdstr[32];
+    char *workers;
+
+    count = DEFAULT_WORKERS;
+
+    if ((workers = get_string_value("DLWORKERS"))) {
+        if (!check_parse_ulong(workers, &count) || count == 0 || count > MAX_WORKERS) {
+            builtin_warning("DLWORKERS %s is not valid, using %u", workers, DEFAULT_WORKERS);
+            count = DEFAULT_WORKERS;
+        }
+    }
+
+    if (!registered) {
+        pthread_atfork(prepare_fork, parent_fork, child_fork);
+        registered = true;
+    }
+
+    if (pipe2(notify, O_CLOEXEC) != 0) {
+        builtin_error("failed to create notification pipe, %s", strerror(errno));
+        return false;
+    }
+
+    // The shell should not be blocked if nobody is collecting results.
+    fcntl(notify[0], F_SETFL, fcntl(notify[0], F_GETFL) | O_NONBLOCK);
+
+    // Workers should never handle signals intended for the shell.
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_SETMASK, &blocked, &saved);
+
+    for (nworkers = 0; nworkers < count; nworkers++) {
+        if (pthread_create(&thread, NULL, async_worker, NULL) != 0)
+            break;
+        pthread_detach(thread);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    if (nworkers == 0) {
+        builtin_error("failed to create any worker threads");
+        close(notify[0]);
+        close(notify[1]);
+        notify[0] = notify[1] = -1;
+        return false;
+    }
+
+    snprintf(fdstr, sizeof fdstr, "%d", notify[0]);
+    bind_variable("DLJOBFD", fdstr, 0);
+
+    return true;
+}
+
+int submit_foreign_call(struct foreign_call *call, const char *resultname, const char *jobname)
+{
+    struct job *job;
+    char idstr[32];
+
+    if (nworkers == 0 && start_worker_pool() != true) {
+        foreign_call_release(call);
+        return EXECUTION_FAILURE;
+    }
+
+    job             = calloc(1, sizeof *job);
+    job->call       = *call;
+    job->resultname = strdup(resultname);
+
+    pthread_mutex_lock(&lock);
+
+    job->id     = nextid++;
+    job->next   = jobs;
+    jobs        = job;
+    *queuetail  = job;
+    queuetail   = &job->queued;
+
+    pthread_cond_signal(&pending);
+    pthread_mutex_unlock(&lock);
+
+    snprintf(idstr, sizeof idstr, "%lu", job->id);
+
+    if (interactive_shell) {
+        fprintf(stderr, "%s\n", idstr);
+    }
+
+    bind_variable((char *) jobname, idstr, 0);
+
+    return EXECUTION_SUCCESS;
+}
+
+// Bind the result of a completed job, and release it.
+static void collect_job(struct job *job)
+{
+    struct job **p;
+    char *retval;
+    char c;
+
+    pthread_mutex_lock(&lock);
+
+    for (p = &jobs; *p != job; p = &(*p)->next)
+        ;
+
+    *p = job->next;
+
+    pthread_mutex_unlock(&lock);
+
+    // Consume the notification for this job.
+    read(notify[0], &c, 1);
+
+    if ((retval = foreign_call_result(&job->call))) {
+        if (interactive_shell) {
+            fprintf(stderr, "%s\n", retval);
+        }
+
+        bind_variable(job->resultname, retval, 0);
+        free(retval);
+    }
+
+    foreign_call_release(&job->call);
+    free(job->resultname);
+    free(job);
+}
+
+static struct job * find_job(unsigned long id)
+{
+    for (struct job *job = jobs; job; job = job->next) {
+        if (job->id == id)
+            return job;
+    }
+
+    return NULL;
+}
+
+// Wait for a specific job, or any job if job is NULL.
+static struct job * wait_for_job(struct job *job)
+{
+    struct job *p;
+
+    pthread_mutex_lock(&lock);
+
+    while (true) {
+        if (job) {
+            if (job->complete)
+                break;
+        } else {
+            for (p = jobs; p && !p->complete; p = p->next)
+                ;
+
+            if ((job = p))
+                break;
+        }
+
+        pthread_cond_wait(&completed, &lock);
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return job;
+}
+
+// Usage:
+//
+// dlwait [-n] [-v var] [jobvar ...]
+//
+static int wait_foreign_call(WORD_LIST *list)
+{
+    struct job *job;
+    unsigned long id;
+    char idstr[32];
+    char *idvar;
+    char *value;
+    bool any;
+    int opt;
+    int result;
+
+    any     = false;
+    idvar   = "DLJOB";
+    result  = EXECUTION_SUCCESS;
+
+    reset_internal_getopt();
+
+    while ((opt = internal_getopt(list, "nv:")) != -1) {
+        switch (opt) {
+            case 'n':
+                any = true;
+                break;
+            case 'v':
+                idvar = list_optarg;
+                break;
+            default:
+                builtin_usage();
+                return EX_USAGE;
+        }
+    }
+
+    list = loptend;
+
+    // Wait for the next job to complete, whichever that is.
+    if (any) {
+        if (jobs == NULL) {
+            builtin_warning("no outstanding asynchronous calls");
+            return EXECUTION_FAILURE;
+        }
+
+        job = wait_for_job(NULL);
+
+        snprintf(idstr, sizeof idstr, "%lu", job->id);
+        bind_variable(idvar, idstr, 0);
+
+        collect_job(job);
+        return EXECUTION_SUCCESS;
+    }
+
+    // No jobs specified, so wait for everything.
+    if (list == NULL) {
+        while (jobs) {
+            collect_job(wait_for_job(jobs));
+        }
+        return EXECUTION_SUCCESS;
+    }
+
+    for (; list; list = list->next) {
+        if (!(value = get_string_value(list->word->word))) {
+            value = list->word->word;
+        }
+
+        if (!check_parse_ulong(value, &id) || !(job = find_job(id))) {
+            builtin_warning("%s is not an outstanding asynchronous call", list->word->word);
+            result = EXECUTION_FAILURE;
+            continue;
+        }
+
+        collect_job(wait_for_job(job));
+    }
+
+    return result;
+}
+
+static char *dlwait_usage[] = {
+    "Collect the result of an asynchronous dlcall.",
+    "",
+    "Calls made with dlcall -A are executed by a pool of native threads,",
+    "allowing a script to overlap slow operations. dlwait blocks until the",
+    "specified jobs have completed, then stores their return values in the",
+    "variable requested by the original dlcall (DLRETVAL by default).",
+    "",
+    "Each job may only be collected once. With no jobs specified, dlwait",
+    "waits for all outstanding calls.",
+    "",
+    "The read end of a pipe is stored in DLJOBFD, a newline becomes",
+    "readable for every call that completes. This allows completion to be",
+    "detected with poll(), select() or read -u alongside other fds. dlwait",
+    "consumes the newline when the job is collected.",
+    "",
+    "The number of worker threads can be set with DLWORKERS before the first",
+    "asynchronous call (default: 4).",
+    "",
+    "Subshells do not inherit the workers or outstanding calls, a subshell",
+    "can only wait for calls it made itself.",
+    "",
+    "Usage:",
+    "",
+    "    $ dlcall -A a -n first -r int usleep 100000",
+    "    $ dlcall -A b -n second -r int usleep 100000",
+    "    $ dlwait a b",
+    "    $ echo $first $second",
+    "    int:0 int:0",
+    "",
+    "    Collect results in the order they finish:",
+    "",
+    "    $ while dlwait -n -v id 2> /dev/null; do echo job $id finished; done",
+    "",
+    "Options:",
+    "    -n          Wait for the next call to complete, rather than a specific job.",
+    "    -v var      With -n, store the identifier of the job in var, not DLJOB.",
+    "",
+    "Exit Status:",
+    "The return code is zero, unless a job was not recognised or -n was",
+    "specified and there are no outstanding calls.",
+    NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) dlwait_struct = {
+    .name       = "dlwait",
+    .function   = wait_foreign_call,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = dlwait_usage,
+    .short_doc  = "dlwait [-n] [-v var] [job ...]",
+    .handle     = NULL,
+};
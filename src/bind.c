@@ -0,0 +1,540 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ffi.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "common.h"
+#include "util.h"
+#include "types.h"
+#include "call.h"
+#include "stats.h"
+#include "probes.h"
+#include "trace.h"
+#include "shell.h"
+
+// A native function bound to a new builtin. The builtin function pointer is
+// an ffi closure, so that each builtin knows which function to call without
+// having to parse its own name.
+struct binding {
+    char *name;
+    char **prefixes;            // Type prefix of each parameter.
+    struct foreign_call call;   // Prepared call, the values are unused.
+    ffi_closure *closure;
+    sh_builtin_func_t *entry;   // Executable address of the closure.
+    char *short_doc;
+    char *long_doc[2];
+    struct binding *next;
+};
+
+static struct binding *bindings;
+
+// The signature of a builtin, int function(WORD_LIST *list).
+static ffi_type *builtin_argtypes[] = { &ffi_type_pointer };
+static ffi_cif builtin_cif;
+
+static struct binding * find_binding(sh_builtin_func_t *function)
+{
+    for (struct binding *binding = bindings; binding; binding = binding->next) {
+        if (binding->entry == function)
+            return binding;
+    }
+
+    return NULL;
+}
+
+static struct builtin * find_builtin_entry(const char *name)
+{
+    for (int i = 0; i < num_shell_builtins; i++) {
+        if (strcmp(shell_builtins[i].name, name) == 0)
+            return &shell_builtins[i];
+    }
+
+    return NULL;
+}
+
+static void free_binding(struct binding *binding)
+{
+    struct binding **prev;
+
+    for (prev = &bindings; *prev; prev = &(*prev)->next) {
+        if (*prev == binding) {
+            *prev = binding->next;
+            break;
+        }
+    }
+
+    for (unsigned i = 0; i < binding->call.nargs; i++)
+        free(binding->prefixes[i]);
+
+    if (binding->closure)
+        ffi_closure_free(binding->closure);
+
+    foreign_call_release(&binding->call);
+    free(binding->prefixes);
+    free(binding->short_doc);
+    free(binding->long_doc[0]);
+    free(binding->name);
+    free(binding);
+}
+
+// Decode a parameter to a bound function. The type is already known, so the
+// prefix is optional, e.g. a pointer parameter accepts 0x1234 or pointer:0x1234.
+static bool decode_bound_parameter(const char *prefix, const char *word, void **value)
+{
+    size_t length = strlen(prefix);
+
+    if (strncmp(word, prefix, length) == 0 && word[length] == ':') {
+        word += length + 1;
+    }
+
+    return decode_type_prefix(prefix, word, NULL, value, NULL);
+}
+
+// This is the body of every bound builtin, binding is the closure user data.
+static int execute_bound_function(struct binding *binding, WORD_LIST *list)
+{
+    struct foreign_call *call = &binding->call;
+    struct stats_timer timer;
+    WORD_LIST *word;
+    unsigned nargs;
+    void **values;
+    void *retval;
+    uint64_t start;
+    char *result;
+    int status;
+
+    status  = EXECUTION_FAILURE;
+
+    stats_start(&timer);
+
+    for (nargs = 0, word = list; word; word = word->next)
+        nargs++;
+
+    if (nargs != call->nargs) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    // These are local rather than in the prepared call, in case a callback
+    // re-enters this builtin.
+    values  = alloca(nargs * sizeof(void *));
+    retval  = alloca(call->rettype->size > sizeof(ffi_arg)
+                        ? call->rettype->size
+                        : sizeof(ffi_arg));
+
+    memset(values, 0, nargs * sizeof(void *));
+
+    for (unsigned i = 0; i < nargs; i++, list = list->next) {
+        if (decode_bound_parameter(binding->prefixes[i], list->word->word, &values[i]) != true) {
+            // The value has already been released.
+            values[i] = NULL;
+            builtin_error("failed to decode %s as parameter %u, expected %s",
+                          list->word->word,
+                          i,
+                          binding->prefixes[i]);
+            goto cleanup;
+        }
+    }
+
+    stats_mark(&timer, STATS_DECODE);
+
+    PROBE2(dlcall_entry, binding->name, nargs);
+
+    start = PROBE_ENABLED(dlcall_return) ? stats_clock() : 0;
+
+    foreign_call_dispatch(call, retval, values);
+
+    if (PROBE_ENABLED(dlcall_return))
+        PROBE2(dlcall_return, binding->name, stats_clock() - start);
+
+    stats_mark(&timer, STATS_CALL);
+
+    if ((result = foreign_call_encode(call, retval))) {
+        if (interactive_shell) {
+            fprintf(stderr, "%s\n", result);
+        }
+
+        bind_variable("DLRETVAL", result, 0);
+        free(result);
+    }
+
+    status = EXECUTION_SUCCESS;
+
+    stats_mark(&timer, STATS_BIND);
+    stats_commit(&timer, binding->name);
+
+  cleanup:
+    for (unsigned i = 0; i < nargs; i++)
+        free(values[i]);
+
+    return status;
+}
+
+static void bound_function_trampoline(ffi_cif *cif, void *retval, void **args, void *user)
+{
+    struct binding *binding = user;
+    WORD_LIST *list = *(WORD_LIST **) args[0];
+    uint32_t nargs;
+    uint64_t start;
+    int result;
+
+    // Bound builtins are created after the trace wrappers are installed, so
+    // they record themselves.
+    start   = trace_begin();
+    result  = execute_bound_function(binding, list);
+
+    if (trace_enabled) {
+        for (nargs = 0; list; list = list->next)
+            nargs++;
+
+        trace_end(binding->name, NULL, nargs, start, result);
+    }
+
+    *(ffi_arg *) retval = result;
+}
+
+// Add a new builtin to the shell, this is how enable -f does it.
+static void add_shell_builtin(struct builtin *builtin)
+{
+    struct builtin *table;
+
+    table = malloc((num_shell_builtins + 2) * sizeof(struct builtin));
+
+    memcpy(table, shell_builtins, num_shell_builtins * sizeof(struct builtin));
+    memcpy(&table[num_shell_builtins], builtin, sizeof(struct builtin));
+    memset(&table[num_shell_builtins + 1], 0, sizeof(struct builtin));
+
+    if (shell_builtins != static_shell_builtins)
+        free(shell_builtins);
+
+    shell_builtins = table;
+    num_shell_builtins++;
+
+    initialize_shell_builtins();
+}
+
+static void remove_shell_builtin(struct builtin *builtin)
+{
+    size_t index = builtin - shell_builtins;
+
+    // The table is always terminated by an empty entry, which is moved too.
+    memmove(&shell_builtins[index],
+            &shell_builtins[index + 1],
+            (num_shell_builtins - index) * sizeof(struct builtin));
+
+    num_shell_builtins--;
+
+    initialize_shell_builtins();
+}
+
+// Install binding as a builtin, replacing any previous binding with the same
+// name.
+static bool install_binding(struct binding *binding)
+{
+    struct builtin builtin = {0};
+    struct builtin *existing;
+    struct binding *previous;
+
+    builtin.name        = binding->name;
+    builtin.function    = binding->entry;
+    builtin.flags       = BUILTIN_ENABLED;
+    builtin.long_doc    = binding->long_doc;
+    builtin.short_doc   = binding->short_doc;
+
+    if ((existing = find_builtin_entry(binding->name))) {
+        if (!(previous = find_binding(existing->function))) {
+            builtin_error("%s is already a builtin", binding->name);
+            return false;
+        }
+
+        existing->name      = builtin.name;
+        existing->function  = builtin.function;
+        existing->long_doc  = builtin.long_doc;
+        existing->short_doc = builtin.short_doc;
+
+        free_binding(previous);
+    } else {
+        add_shell_builtin(&builtin);
+    }
+
+    binding->next = bindings;
+    bindings      = binding;
+    return true;
+}
+
+// Parse one binding, i.e. everything up to the next ; separator. On success,
+// *plist is left pointing at the separator, or NULL if this was the final
+// binding.
+//
+//  [-r type] [-h handle] [-n name] symbol [types...]
+//
+static struct binding * parse_binding(WORD_LIST **plist)
+{
+    struct binding *binding;
+    WORD_LIST *list = *plist;
+    ffi_type *rettype;
+    ffi_type *type;
+    void *handle;
+    void *func;
+    char *format;
+    char *layout;
+    char *name;
+    char *retspec;
+    FILE *doc;
+    size_t doclen;
+
+    rettype = &ffi_type_void;
+    retspec = "void";
+    format  = NULL;
+    layout  = NULL;
+    name    = NULL;
+    handle  = RTLD_DEFAULT;
+
+    for (; list && *list->word->word == '-'; list = list->next->next) {
+        if (list->next == NULL) {
+            builtin_error("option %s requires an argument", list->word->word);
+            goto cleanup;
+        }
+
+        if (strcmp(list->word->word, "-r") == 0) {
+            free(layout);
+            if (foreign_call_decode_return(list->next->word->word, &rettype, &format, &layout) != true) {
+                builtin_warning("failed to parse return type");
+                return NULL;
+            }
+            retspec = list->next->word->word;
+        } else if (strcmp(list->word->word, "-h") == 0) {
+            if (check_parse_ulong(list->next->word->word, (void *) &handle) == 0) {
+                builtin_warning("handle %s is not well-formed", list->next->word->word);
+                goto cleanup;
+            }
+        } else if (strcmp(list->word->word, "-n") == 0) {
+            name = list->next->word->word;
+        } else {
+            builtin_error("unrecognised option %s", list->word->word);
+            goto cleanup;
+        }
+    }
+
+    if (list == NULL || strcmp(list->word->word, ";") == 0) {
+        builtin_error("a symbol to bind is required");
+        goto cleanup;
+    }
+
+    if (!(func = dlsym(handle, list->word->word))) {
+        builtin_warning("failed to resolve symbol %s, %s", list->word->word, dlerror());
+        goto cleanup;
+    }
+
+    if (strchr(name = name ? name : list->word->word, '/')) {
+        builtin_error("%s is not a valid builtin name", name);
+        goto cleanup;
+    }
+
+    binding         = calloc(1, sizeof *binding);
+    binding->name   = strdup(name);
+
+    foreign_call_init(&binding->call, func, rettype, format, layout);
+
+    // The short_doc is the signature, e.g. strlen string
+    doc = open_memstream(&binding->short_doc, &doclen);
+
+    fprintf(doc, "%s", name);
+
+    for (list = list->next; list && strcmp(list->word->word, ";") != 0; list = list->next) {
+        if (decode_type_prefix(list->word->word, NULL, &type, NULL, NULL) != true) {
+            builtin_error("failed to decode type from parameter %s", list->word->word);
+            fclose(doc);
+            goto error;
+        }
+
+        if (type == &ffi_type_void) {
+            builtin_error("parameters cannot be void");
+            fclose(doc);
+            goto error;
+        }
+
+        binding->prefixes = realloc(binding->prefixes, (binding->call.nargs + 1) * sizeof(char *));
+        binding->prefixes[binding->call.nargs] = strdup(list->word->word);
+
+        foreign_call_append_value(&binding->call, type, NULL);
+
+        fprintf(doc, " %s", list->word->word);
+    }
+
+    fclose(doc);
+
+    if (asprintf(&binding->long_doc[0], "Call the native function %s, returning %s. See dlbind.",
+                 name,
+                 retspec) < 0) {
+        binding->long_doc[0] = NULL;
+        goto error;
+    }
+
+    if (foreign_call_prepare(&binding->call) != true)
+        goto error;
+
+    binding->closure = ffi_closure_alloc(sizeof(ffi_closure), (void **) &binding->entry);
+
+    if (binding->closure == NULL
+     || ffi_prep_closure_loc(binding->closure,
+                             &builtin_cif,
+                             bound_function_trampoline,
+                             binding,
+                             binding->entry) != FFI_OK) {
+        builtin_error("failed to generate builtin for %s", name);
+        goto error;
+    }
+
+    *plist = list;
+    return binding;
+
+  error:
+    free_binding(binding);
+    return NULL;
+
+  cleanup:
+    free(layout);
+    return NULL;
+}
+
+// Remove builtins previously created by dlbind.
+static int unbind_functions(WORD_LIST *list)
+{
+    struct builtin *builtin;
+    struct binding *binding;
+    int result = EXECUTION_SUCCESS;
+
+    for (; list; list = list->next) {
+        if (!(builtin = find_builtin_entry(list->word->word))
+         || !(binding = find_binding(builtin->function))) {
+            builtin_error("%s was not created by dlbind", list->word->word);
+            result = EXECUTION_FAILURE;
+            continue;
+        }
+
+        remove_shell_builtin(builtin);
+        free_binding(binding);
+    }
+
+    return result;
+}
+
+// Usage:
+//
+// dlbind [-r type] [-h handle] [-n name] symbol [types...] [\; ...]
+// dlbind -d name...
+//
+static int bind_native_functions(WORD_LIST *list)
+{
+    struct binding **pending;
+    unsigned count;
+    int result;
+
+    pending = NULL;
+    count   = 0;
+    result  = EXECUTION_FAILURE;
+
+    if (list == NULL) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    if (strcmp(list->word->word, "-d") == 0) {
+        return unbind_functions(list->next);
+    }
+
+    if (builtin_cif.rtype == NULL
+     && ffi_prep_cif(&builtin_cif, FFI_DEFAULT_ABI, 1, &ffi_type_sint, builtin_argtypes) != FFI_OK) {
+        builtin_error("failed to prepare builtin interface");
+        return EXECUTION_FAILURE;
+    }
+
+    // Decode every binding before installing any of them, so that a mistake
+    // in the list doesn't leave it half bound.
+    while (list) {
+        pending = realloc(pending, (count + 1) * sizeof(struct binding *));
+
+        if (!(pending[count] = parse_binding(&list)))
+            goto cleanup;
+
+        count++;
+
+        // Skip the separator.
+        if (list)
+            list = list->next;
+    }
+
+    result = EXECUTION_SUCCESS;
+
+    for (unsigned i = 0; i < count; i++) {
+        if (install_binding(pending[i]) != true) {
+            free_binding(pending[i]);
+            result = EXECUTION_FAILURE;
+        }
+    }
+
+    free(pending);
+    return result;
+
+  cleanup:
+    for (unsigned i = 0; i < count; i++)
+        free_binding(pending[i]);
+
+    free(pending);
+    return result;
+}
+
+static char *dlbind_usage[] = {
+    "Create builtins that call native functions directly.",
+    "",
+    "Every dlcall command has to parse options, resolve the symbol and",
+    "prepare a call interface before calling anything. dlbind does that work",
+    "once, and creates a new builtin that calls the function directly. The",
+    "parameter types are fixed when the function is bound, so the prefix on",
+    "each parameter is optional.",
+    "",
+    "Several functions can be bound at once by separating them with `;`.",
+    "Each function is specified like a dlcall command, except that a list of",
+    "type prefixes follows the symbol instead of parameters. Use -n to choose",
+    "a different name for the builtin, the default is the symbol name.",
+    "",
+    "The bound builtin stores the return value in DLRETVAL, and replaces any",
+    "previous binding with the same name. Existing builtins cannot be",
+    "replaced.",
+    "",
+    "Usage:",
+    "",
+    "    $ dlbind -r long strlen string \\; -r int -n cabs abs int",
+    "    $ strlen hello",
+    "    long:5",
+    "    $ cabs -42",
+    "    int:42",
+    "    $ dlbind -d strlen cabs",
+    "",
+    "Options:",
+    "    -r type     The function returns the specified type (default: void).",
+    "    -h handle   Use handle instead of RTLD_DEFAULT to resolve symbol.",
+    "    -n name     Name the builtin name instead of symbol.",
+    "    -d          Remove the builtins listed, which must have been created",
+    "                by dlbind.",
+    "",
+    "Exit Status:",
+    "The return code is zero, unless a function could not be bound.",
+    NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) dlbind_struct = {
+    .name       = "dlbind",
+    .function   = bind_native_functions,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = dlbind_usage,
+    .short_doc  = "dlbind [-r type] [-h handle] [-n name] symbol [types...] [\\; ...]",
+    .handle     = NULL,
+};
@@ -0,0 +1,912 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "arrayfunc.h"
+#include "common.h"
+#include "bashgetopt.h"
+#include "util.h"
+#include "unpack.h"
+#include "trace.h"
+#include "buffer.h"
+#include "shell.h"
+
+// Named native buffers, managed by the buf builtin.
+//
+// Buffers are allocated from named arenas, each of which keeps a free list
+// for every power of two size class from 16 bytes to 64K. Blocks are carved
+// from large slabs, so most allocations are a pointer pop, and freeing a
+// whole arena releases every slab at once. Larger buffers use malloc.
+//
+// A buffer called name is also an indexed array variable (pointer size), so
+// that $name can be passed directly to dlcall, pack or unpack.
+#define CLASS_MIN_SHIFT     4
+#define CLASS_MAX_SHIFT     16
+#define NCLASSES            (CLASS_MAX_SHIFT - CLASS_MIN_SHIFT + 1)
+#define SLAB_SIZE           (256 * 1024)
+#define DEFAULT_ARENA       "default"
+
+// Special classes for buffers that are not in a slab.
+#define CLASS_LARGE         -1
+#define CLASS_SLICE         -2
+
+struct block {
+    struct block *next;
+};
+
+struct slab {
+    struct slab *next;
+    size_t size;
+    size_t used;
+    uint8_t data[] __attribute__((aligned(16)));
+};
+
+struct arena {
+    char *name;
+    struct block *free[NCLASSES];
+    struct slab *slabs;
+    struct arena *next;
+};
+
+struct buffer {
+    char *name;
+    struct arena *arena;
+    uint8_t *data;
+    size_t size;
+    int class;
+    struct buffer *parent;      // The buffer a slice views.
+    size_t offset;              // Offset of a slice into parent.
+    struct buffer *slices;      // Slices of this buffer.
+    struct buffer *sibling;     // Next slice of parent.
+    SHELL_VAR *var;             // The variable name, when it was last bound.
+    uint8_t *bound;             // The address stored in var.
+};
+
+// A region created by dlscope, every buffer created while it is the
+// innermost scope is allocated from its arena.
+//
+// Bash has no hook for function return that a builtin can use, unwind
+// protects added by builtins are discarded when the builtin returns. Instead
+// a scope started in a function creates a local marker variable, once that
+// has gone the function has returned, and the scope is released the next
+// time a scope or buffer is used.
+struct scope {
+    unsigned id;
+    char *arena;
+    char *marker;               // Local variable, or NULL at top level.
+    struct scope *next;
+};
+
+// The flags parameter was added in bash 5, it is ignored by older versions.
+typedef SHELL_VAR * make_local_variable_t(const char *name, int flags);
+
+static struct arena *arenas;
+static struct scope *scopes;
+
+// Map of names to struct buffer.
+static HASH_TABLE *buffers;
+
+static int size_class(size_t size)
+{
+    for (int class = 0; class < NCLASSES; class++) {
+        if (size <= (1UL << (class + CLASS_MIN_SHIFT)))
+            return class;
+    }
+
+    return CLASS_LARGE;
+}
+
+static size_t class_size(int class)
+{
+    return 1UL << (class + CLASS_MIN_SHIFT);
+}
+
+static struct arena * find_arena(const char *name, bool create)
+{
+    struct arena *arena;
+
+    for (arena = arenas; arena; arena = arena->next) {
+        if (strcmp(arena->name, name) == 0)
+            return arena;
+    }
+
+    if (!create)
+        return NULL;
+
+    arena           = calloc(1, sizeof *arena);
+    arena->name     = strdup(name);
+    arena->next     = arenas;
+    arenas          = arena;
+    return arena;
+}
+
+// Allocate size zeroed bytes from arena, setting class. Returns NULL if the
+// memory could not be allocated.
+static void * arena_alloc(struct arena *arena, size_t size, int *class)
+{
+    struct block *block;
+    struct slab *slab;
+    size_t blocksize;
+
+    if ((*class = size_class(size)) == CLASS_LARGE)
+        return calloc(1, size);
+
+    blocksize = class_size(*class);
+
+    if ((block = arena->free[*class])) {
+        arena->free[*class] = block->next;
+        return memset(block, 0, blocksize);
+    }
+
+    slab = arena->slabs;
+
+    if (!slab || slab->size - slab->used < blocksize) {
+        if (!(slab = malloc(sizeof *slab + SLAB_SIZE)))
+            return NULL;
+
+        slab->size  = SLAB_SIZE;
+        slab->used  = 0;
+        slab->next  = arena->slabs;
+
+        arena->slabs = slab;
+    }
+
+    block       = (struct block *) &slab->data[slab->used];
+    slab->used += blocksize;
+
+    return memset(block, 0, blocksize);
+}
+
+static void arena_release(struct arena *arena, void *data, int class)
+{
+    struct block *block = data;
+
+    if (class == CLASS_LARGE) {
+        free(data);
+    } else if (class != CLASS_SLICE) {
+        block->next         = arena->free[class];
+        arena->free[class]  = block;
+    }
+}
+
+static struct buffer * find_buffer(const char *name)
+{
+    BUCKET_CONTENTS *bucket;
+
+    if (buffers && (bucket = hash_search(name, buffers, 0)))
+        return bucket->data;
+
+    builtin_error("%s is not a buffer, check `help buf`", name);
+    return NULL;
+}
+
+// Create the array variable name for a new buffer. In a function it's local
+// to the function, like local -a, otherwise any existing variable is replaced
+// rather than shadowed.
+static SHELL_VAR * make_buffer_variable(char *name)
+{
+    make_local_variable_t *make_local = (void *) make_local_variable;
+    SHELL_VAR *var;
+
+    if (variable_context == 0) {
+        unbind_variable(name);
+        return make_new_array_variable(name);
+    }
+
+    if (!(var = make_local(name, 0)))
+        return NULL;
+
+    if (readonly_p(var) || assoc_p(var)) {
+        builtin_error("%s: cannot be replaced by a buffer", name);
+        return NULL;
+    }
+
+    return array_p(var) ? var : convert_var_to_array(var);
+}
+
+// Return the variable of buffer, or NULL if it has gone. A function that bound
+// it may have returned, and the name may now be another variable, possibly
+// allocated at the same address, so the address it holds is checked too.
+static SHELL_VAR * buffer_variable(struct buffer *buffer)
+{
+    SHELL_VAR *var;
+    char value[128];
+    char *element;
+
+    var = find_variable(buffer->name);
+
+    if (!var || var != buffer->var || !array_p(var) || invisible_p(var))
+        return NULL;
+
+    snprintf(value, sizeof value, "pointer:%p", buffer->bound);
+
+    if (!(element = array_reference(array_cell(var), 0)) || strcmp(element, value) != 0)
+        return NULL;
+
+    return var;
+}
+
+// Set the variable name to (pointer size), for this buffer and its slices. A
+// buffer that is already bound, e.g. after a resize, keeps its variable.
+static void bind_buffer(struct buffer *buffer)
+{
+    SHELL_VAR *array;
+    char value[128];
+
+    if (!buffer_variable(buffer))
+        buffer->var = make_buffer_variable(buffer->name);
+
+    buffer->bound = buffer->data;
+
+    if ((array = buffer->var)) {
+        array_flush(array_cell(array));
+
+        snprintf(value, sizeof value, "pointer:%p", buffer->data);
+        bind_array_element(array, 0, value, 0);
+
+        snprintf(value, sizeof value, "%zu", buffer->size);
+        bind_array_element(array, 1, value, 0);
+    }
+
+    for (struct buffer *slice = buffer->slices; slice; slice = slice->sibling) {
+        slice->data = buffer->data + slice->offset;
+        bind_buffer(slice);
+    }
+}
+
+static struct buffer * insert_buffer(const char *name, struct arena *arena)
+{
+    struct buffer *buffer;
+    BUCKET_CONTENTS *bucket;
+
+    if (!buffers)
+        buffers = hash_create(64);
+
+    buffer          = calloc(1, sizeof *buffer);
+    buffer->name    = strdup(name);
+    buffer->arena   = arena;
+
+    bucket          = hash_insert(strdup(name), buffers, 0);
+    bucket->data    = buffer;
+
+    return buffer;
+}
+
+static void destroy_buffer(struct buffer *buffer)
+{
+    BUCKET_CONTENTS *bucket;
+    struct buffer **slice;
+
+    while (buffer->slices)
+        destroy_buffer(buffer->slices);
+
+    if (buffer->parent) {
+        for (slice = &buffer->parent->slices; *slice != buffer; slice = &(*slice)->sibling)
+            ;
+
+        *slice = buffer->sibling;
+    }
+
+    if ((bucket = hash_remove(buffer->name, buffers, 0))) {
+        free(bucket->key);
+        free(bucket);
+    }
+
+    arena_release(buffer->arena, buffer->data, buffer->class);
+
+    // Only unset the variable if it's still this buffer.
+    if (buffer_variable(buffer))
+        unbind_variable(buffer->name);
+
+    free(buffer->name);
+    free(buffer);
+}
+
+// Create a new zeroed buffer called name in arena, or the current scope,
+// replacing any existing buffer with that name. Returns NULL if the memory
+// could not be allocated, leaving any existing buffer intact.
+static void * buffer_create(const char *name, const char *arenaname, size_t size)
+{
+    BUCKET_CONTENTS *bucket;
+    struct buffer *buffer;
+    struct arena *arena;
+    uint8_t *data;
+    int class;
+
+    if (!arenaname)
+        arenaname = scopes ? scopes->arena : DEFAULT_ARENA;
+
+    arena = find_arena(arenaname, true);
+
+    if (!(data = arena_alloc(arena, size, &class))) {
+        builtin_error("failed to allocate %zu bytes for %s", size, name);
+        return NULL;
+    }
+
+    if (buffers && (bucket = hash_search(name, buffers, 0)))
+        destroy_buffer(bucket->data);
+
+    buffer          = insert_buffer(name, arena);
+    buffer->size    = size;
+    buffer->data    = data;
+    buffer->class   = class;
+
+    bind_buffer(buffer);
+    return buffer->data;
+}
+
+static bool parse_size(const char *word, size_t *size)
+{
+    unsigned long value;
+
+    if (check_parse_ulong(word, &value) != true) {
+        builtin_error("failed to parse `%s`, expected a number", word);
+        return false;
+    }
+
+    *size = value;
+    return true;
+}
+
+static unsigned count_words(WORD_LIST *list)
+{
+    unsigned count;
+
+    for (count = 0; list; list = list->next)
+        count++;
+
+    return count;
+}
+
+static int resize_buffer(struct buffer *buffer, size_t size)
+{
+    uint8_t *data;
+    int class;
+
+    if (buffer->class == CLASS_SLICE) {
+        builtin_error("%s is a slice, and cannot be resized", buffer->name);
+        return EXECUTION_FAILURE;
+    }
+
+    for (struct buffer *slice = buffer->slices; slice; slice = slice->sibling) {
+        if (slice->offset + slice->size > size) {
+            builtin_error("the slice %s would no longer fit in %s", slice->name, buffer->name);
+            return EXECUTION_FAILURE;
+        }
+    }
+
+    // Blocks are often larger than requested, so there may be room already.
+    if (buffer->class != CLASS_LARGE && size <= class_size(buffer->class)) {
+        if (size > buffer->size)
+            memset(buffer->data + buffer->size, 0, size - buffer->size);
+    } else {
+        if (!(data = arena_alloc(buffer->arena, size, &class))) {
+            builtin_error("failed to allocate %zu bytes for %s", size, buffer->name);
+            return EXECUTION_FAILURE;
+        }
+
+        memcpy(data, buffer->data, size < buffer->size ? size : buffer->size);
+
+        arena_release(buffer->arena, buffer->data, buffer->class);
+
+        buffer->data    = data;
+        buffer->class   = class;
+    }
+
+    buffer->size = size;
+
+    bind_buffer(buffer);
+    return EXECUTION_SUCCESS;
+}
+
+static int slice_buffer(struct buffer *parent, size_t offset, size_t size, const char *name)
+{
+    BUCKET_CONTENTS *bucket;
+    struct buffer *slice;
+
+    if (offset > parent->size || size > parent->size - offset) {
+        builtin_error("a slice of %zu bytes at offset %zu does not fit in %s", size, offset, parent->name);
+        return EXECUTION_FAILURE;
+    }
+
+    if (buffers && (bucket = hash_search(name, buffers, 0))) {
+        if (bucket->data == parent) {
+            builtin_error("a buffer cannot replace itself with a slice");
+            return EXECUTION_FAILURE;
+        }
+
+        destroy_buffer(bucket->data);
+    }
+
+    slice           = insert_buffer(name, parent->arena);
+    slice->size     = size;
+    slice->class    = CLASS_SLICE;
+    slice->parent   = parent;
+    slice->offset   = offset;
+    slice->data     = parent->data + offset;
+    slice->sibling  = parent->slices;
+
+    parent->slices  = slice;
+
+    bind_buffer(slice);
+    return EXECUTION_SUCCESS;
+}
+
+struct collect_context {
+    struct buffer **buffers;
+    struct arena *arena;
+    bool roots;                 // Skip slices.
+    unsigned count;
+};
+
+static int collect_buffer(BUCKET_CONTENTS *item, void *user)
+{
+    struct collect_context *ctx = user;
+    struct buffer *buffer = item->data;
+
+    if (ctx->roots && buffer->parent)
+        return 0;
+
+    if (!ctx->arena || buffer->arena == ctx->arena)
+        ctx->buffers[ctx->count++] = buffer;
+
+    return 0;
+}
+
+static int compare_buffers(const void *a, const void *b)
+{
+    return strcmp((*(struct buffer **) a)->name, (*(struct buffer **) b)->name);
+}
+
+// Find every buffer, or every buffer in arena, sorted by name. If roots is
+// set, slices are skipped.
+static struct buffer ** collect_buffers(struct arena *arena, bool roots, unsigned *count)
+{
+    struct collect_context ctx = {
+        .arena = arena,
+        .roots = roots,
+    };
+
+    ctx.buffers = calloc(buffers ? HASH_ENTRIES(buffers) + 1 : 1, sizeof(struct buffer *));
+
+    assoc_walk_data(buffers, collect_buffer, &ctx);
+
+    qsort(ctx.buffers, ctx.count, sizeof(struct buffer *), compare_buffers);
+
+    *count = ctx.count;
+    return ctx.buffers;
+}
+
+static int free_arena(const char *name)
+{
+    struct buffer **list;
+    struct arena **arena;
+    struct arena *found;
+    struct slab *slab;
+    unsigned count;
+
+    for (arena = &arenas; *arena; arena = &(*arena)->next) {
+        if (strcmp((*arena)->name, name) == 0)
+            break;
+    }
+
+    if (!(found = *arena)) {
+        builtin_error("%s is not an arena", name);
+        return EXECUTION_FAILURE;
+    }
+
+    // Destroying a buffer also destroys its slices.
+    list = collect_buffers(found, true, &count);
+
+    for (unsigned i = 0; i < count; i++)
+        destroy_buffer(list[i]);
+
+    free(list);
+
+    while ((slab = found->slabs)) {
+        found->slabs = slab->next;
+        free(slab);
+    }
+
+    *arena = found->next;
+
+    free(found->name);
+    free(found);
+    return EXECUTION_SUCCESS;
+}
+
+// Release scopes down to and including id, which may already be gone.
+static void end_scope(unsigned id)
+{
+    struct scope *scope;
+    bool done;
+
+    for (scope = scopes; scope && scope->id != id; scope = scope->next)
+        ;
+
+    if (!scope)
+        return;
+
+    // Any inner scopes that were not ended are released too.
+    do {
+        scope   = scopes;
+        scopes  = scope->next;
+        done    = scope->id == id;
+
+        if (find_arena(scope->arena, false))
+            free_arena(scope->arena);
+
+        free(scope->marker);
+        free(scope->arena);
+        free(scope);
+    } while (!done);
+}
+
+// Release any scopes started by functions that have returned.
+static void release_stale_scopes(void)
+{
+    struct scope *stale = NULL;
+
+    for (struct scope *scope = scopes; scope; scope = scope->next) {
+        if (scope->marker && !find_variable(scope->marker))
+            stale = scope;
+    }
+
+    // This is the outermost, inner scopes are released with it.
+    if (stale)
+        end_scope(stale->id);
+}
+
+static void begin_scope(void)
+{
+    make_local_variable_t *make_local = (void *) make_local_variable;
+    static unsigned ids;
+    struct scope *scope;
+
+    scope           = calloc(1, sizeof *scope);
+    scope->id       = ++ids;
+    scope->next     = scopes;
+
+    asprintf(&scope->arena, "dlscope.%u", scope->id);
+
+    find_arena(scope->arena, true);
+
+    // Inside a function, the scope ends when the function returns, however
+    // that happens.
+    if (variable_context > 0) {
+        asprintf(&scope->marker, "__dlscope_%u", scope->id);
+
+        make_local(scope->marker, 0);
+
+        bind_variable(scope->marker, scope->arena, 0);
+    }
+
+    scopes          = scope;
+}
+
+// If a scope is active, create a buffer in it and store the address, otherwise
+// store NULL. This is used by sizeof -m, struct -m and pack -z. Returns false
+// if the buffer could not be allocated.
+bool scope_buffer_create(const char *name, size_t size, void **address)
+{
+    release_stale_scopes();
+
+    if (!scopes) {
+        *address = NULL;
+        return true;
+    }
+
+    return (*address = buffer_create(name, NULL, size)) != NULL;
+}
+
+static void print_buffers(struct arena *arena)
+{
+    struct buffer **list;
+    unsigned count;
+
+    list = collect_buffers(arena, false, &count);
+
+    printf("%-24s %-12s %12s  %s\n", "name", "arena", "size", "address");
+
+    for (unsigned i = 0; i < count; i++) {
+        printf("%-24s %-12s %12zu  %p%s%s\n",
+               list[i]->name,
+               list[i]->arena->name,
+               list[i]->size,
+               list[i]->data,
+               list[i]->parent ? " slice of " : "",
+               list[i]->parent ? list[i]->parent->name : "");
+    }
+
+    free(list);
+}
+
+// Usage:
+//
+//  buf [-a arena] name size
+//  buf -r name size
+//  buf -s buffer offset size name
+//  buf -z name [...]
+//  buf -c source dest
+//  buf -d name [...]
+//  buf -F arena [...]
+//  buf [-a arena]
+//
+static int manage_native_buffers(WORD_LIST *list)
+{
+    struct buffer *buffer;
+    struct buffer *source;
+    const char *arena;
+    size_t offset;
+    size_t size;
+    int result;
+    int mode;
+    int opt;
+
+    arena   = NULL;
+    mode    = 0;
+    result  = EXECUTION_SUCCESS;
+
+    release_stale_scopes();
+
+    reset_internal_getopt();
+
+    while ((opt = internal_getopt(list, "a:rszcdF")) != -1) {
+        switch (opt) {
+            case 'a':
+                arena = list_optarg;
+                break;
+            case 'r':
+            case 's':
+            case 'z':
+            case 'c':
+            case 'd':
+            case 'F':
+                if (mode && mode != opt) {
+                    builtin_error("-%c cannot be used with -%c", opt, mode);
+                    return EX_USAGE;
+                }
+                mode = opt;
+                break;
+            default:
+                builtin_usage();
+                return EX_USAGE;
+        }
+    }
+
+    list = loptend;
+
+    if (list)
+        trace_symbol(list->word->word);
+
+    switch (mode) {
+        case 0:
+            if (!list) {
+                if (arena && !find_arena(arena, false)) {
+                    builtin_error("%s is not an arena", arena);
+                    return EXECUTION_FAILURE;
+                }
+
+                print_buffers(arena ? find_arena(arena, false) : NULL);
+                return EXECUTION_SUCCESS;
+            }
+
+            if (count_words(list) != 2) {
+                builtin_usage();
+                return EX_USAGE;
+            }
+
+            if (parse_size(list->next->word->word, &size) != true)
+                return EXECUTION_FAILURE;
+
+            if (!buffer_create(list->word->word, arena, size))
+                return EXECUTION_FAILURE;
+
+            return EXECUTION_SUCCESS;
+        case 'r':
+            if (count_words(list) != 2) {
+                builtin_usage();
+                return EX_USAGE;
+            }
+
+            if (!(buffer = find_buffer(list->word->word))
+             || parse_size(list->next->word->word, &size) != true)
+                return EXECUTION_FAILURE;
+
+            return resize_buffer(buffer, size);
+        case 's':
+            if (count_words(list) != 4) {
+                builtin_usage();
+                return EX_USAGE;
+            }
+
+            if (!(buffer = find_buffer(list->word->word))
+             || parse_size(list->next->word->word, &offset) != true
+             || parse_size(list->next->next->word->word, &size) != true)
+                return EXECUTION_FAILURE;
+
+            return slice_buffer(buffer, offset, size, list->next->next->next->word->word);
+        case 'c':
+            if (count_words(list) != 2) {
+                builtin_usage();
+                return EX_USAGE;
+            }
+
+            if (!(source = find_buffer(list->word->word))
+             || !(buffer = find_buffer(list->next->word->word)))
+                return EXECUTION_FAILURE;
+
+            if (source->size > buffer->size) {
+                builtin_error("%s is too small to hold %s", buffer->name, source->name);
+                return EXECUTION_FAILURE;
+            }
+
+            // Slices can overlap.
+            memmove(buffer->data, source->data, source->size);
+            return EXECUTION_SUCCESS;
+    }
+
+    // The remaining modes accept a list of names.
+    if (!list) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    for (; list; list = list->next) {
+        if (mode == 'F') {
+            if (free_arena(list->word->word) != EXECUTION_SUCCESS)
+                result = EXECUTION_FAILURE;
+            continue;
+        }
+
+        if (!(buffer = find_buffer(list->word->word))) {
+            result = EXECUTION_FAILURE;
+            continue;
+        }
+
+        if (mode == 'z') {
+            memset(buffer->data, 0, buffer->size);
+        } else {
+            destroy_buffer(buffer);
+        }
+    }
+
+    return result;
+}
+
+static char *buf_usage[] = {
+    "Manage named native buffers.",
+    "",
+    "A buffer is a block of native memory with a name. The variable name is",
+    "set to an indexed array containing a pointer to the buffer and its size,",
+    "so $name can be used anywhere a pointer is expected. In a function, the",
+    "variable is local to the function, but the memory is not freed when it",
+    "returns unless it was allocated in a dlscope. New buffers are always",
+    "zeroed.",
+    "",
+    "Buffers are allocated from arenas, which reuse freed memory of a similar",
+    "size. Freeing an arena with -F releases every buffer in it at once, which",
+    "is convenient for memory used while handling one request, for example.",
+    "The default arena is called default.",
+    "",
+    "Usage:",
+    "",
+    "    $ buf data 64",
+    "    $ dlcall memset $data int:65 long:${data[1]}",
+    "    $ buf -s data 16 8 header",
+    "    $ declare -a bytes=(uint8 uint8)",
+    "    $ unpack $header bytes",
+    "    $ buf -r data 128",
+    "    $ buf -d data",
+    "",
+    "    $ buf -a request input 4096",
+    "    $ buf -a request output 4096",
+    "    $ buf -F request",
+    "",
+    "With no parameters, all buffers are listed.",
+    "",
+    "Options:",
+    "    -a arena    Create the buffer in arena, or only list arena.",
+    "    -r          Resize buffer name to size, preserving the contents.",
+    "    -s          Make name a view of size bytes at offset into buffer.",
+    "                Slices are freed with the buffer they view.",
+    "    -z          Zero every byte of the named buffers.",
+    "    -c          Copy the contents of source to the start of dest.",
+    "    -d          Free the named buffers.",
+    "    -F          Free every buffer in the named arenas.",
+    "",
+    NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) buf_struct = {
+    .name       = "buf",
+    .function   = manage_native_buffers,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = buf_usage,
+    .short_doc  = "buf [-a arena] [-r|-s|-z|-c|-d|-F] [name size|buffer offset size name|source dest|name...]",
+    .handle     = NULL,
+};
+
+// Usage:
+//
+//  dlscope begin
+//  dlscope end
+//  dlscope
+//
+static int manage_allocation_scopes(WORD_LIST *list)
+{
+    release_stale_scopes();
+
+    if (!list) {
+        for (struct scope *scope = scopes; scope; scope = scope->next)
+            printf("%s\n", scope->arena);
+
+        return EXECUTION_SUCCESS;
+    }
+
+    if (list->next) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    if (strcmp(list->word->word, "begin") == 0) {
+        begin_scope();
+        return EXECUTION_SUCCESS;
+    }
+
+    if (strcmp(list->word->word, "end") == 0) {
+        if (!scopes) {
+            builtin_error("there is no scope to end");
+            return EXECUTION_FAILURE;
+        }
+
+        end_scope(scopes->id);
+        return EXECUTION_SUCCESS;
+    }
+
+    builtin_usage();
+    return EX_USAGE;
+}
+
+static char *dlscope_usage[] = {
+    "Release native allocations automatically.",
+    "",
+    "Between dlscope begin and dlscope end, buffers created by buf without -a,",
+    "sizeof -m and struct -m are allocated from a region that belongs to the",
+    "scope, and are all released together when it ends. Don't release them",
+    "with dlcall free.",
+    "",
+    "When dlscope begin is used in a function, the scope also ends when the",
+    "function returns, so error paths can't leak. The memory is released by",
+    "the next dlscope, buf, sizeof -m or struct -m command, so it stays",
+    "bounded when the function is called in a loop. Scopes can be nested,",
+    "ending a scope also ends any scopes inside it.",
+    "",
+    "Usage:",
+    "",
+    "    function lookup {",
+    "        dlscope begin",
+    "        sizeof -m hints addrinfo",
+    "        buf result 8",
+    "        dlcall -r int getaddrinfo string:$1 $NULL $hints $result || return 1",
+    "        ...",
+    "    }",
+    "",
+    "With no parameters, the active scopes are listed, innermost first.",
+    "",
+    NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) dlscope_struct = {
+    .name       = "dlscope",
+    .function   = manage_allocation_scopes,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = dlscope_usage,
+    .short_doc  = "dlscope [begin|end]",
+    .handle     = NULL,
+};
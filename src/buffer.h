@@ -0,0 +1,6 @@
+#ifndef __BUFFER_H
+#define __BUFFER_H
+
+bool scope_buffer_create(const char *name, size_t size, void **address);
+
+#endif
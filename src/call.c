@@ -0,0 +1,402 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ffi.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "common.h"
+#include "types.h"
+#include "layout.h"
+#include "call.h"
+
+// Decode the return type of a call, which is either a type prefix, or
+// struct:NAME[=var] for a structure returned by value. The caller should free
+// layout, which is NULL for primitive types.
+bool foreign_call_decode_return(const char *prefix, ffi_type **rettype, char **format, char **layout)
+{
+    *layout = NULL;
+    *format = NULL;
+
+    if (strncmp(prefix, "struct:", strlen("struct:")) == 0) {
+        return decode_struct_prefix(prefix + strlen("struct:"), layout, rettype);
+    }
+
+    return decode_type_prefix(prefix, NULL, rettype, NULL, format);
+}
+
+// Initialize an empty call to func, parameters are added with
+// foreign_call_append(). If layout is not NULL, the call takes ownership and
+// the result is unpacked into it.
+void foreign_call_init(struct foreign_call *call, void *func, ffi_type *rettype, char *format, char *layout)
+{
+    memset(call, 0, sizeof *call);
+
+    call->func      = func;
+    call->rettype   = rettype;
+    call->format    = format;
+    call->layout    = layout;
+
+    // libffi always writes at least an ffi_arg for integral return types,
+    // even if the declared type is smaller.
+    call->retval    = calloc(1, rettype->size > sizeof(ffi_arg)
+                                    ? rettype->size
+                                    : sizeof(ffi_arg));
+}
+
+// Add a parameter that has already been decoded, the call takes ownership of
+// value.
+bool foreign_call_append_value(struct foreign_call *call, ffi_type *type, void *value)
+{
+    ffi_type **argtypes;
+    void **values;
+
+    if (!(argtypes = realloc(call->argtypes, (call->nargs + 1) * sizeof(ffi_type *))))
+        return false;
+
+    call->argtypes = argtypes;
+
+    if (!(values = realloc(call->values, (call->nargs + 1) * sizeof(void *))))
+        return false;
+
+    call->values = values;
+
+    call->argtypes[call->nargs] = type;
+    call->values[call->nargs]   = value;
+    call->nargs++;
+    return true;
+}
+
+// Pack a layout into a structure passed by value, e.g. struct:timespec=ts
+static bool foreign_call_append_struct(struct foreign_call *call, const char *spec)
+{
+    ffi_type *type;
+    char *name;
+    void *value;
+
+    if (decode_struct_prefix(spec, &name, &type) != true) {
+        return false;
+    }
+
+    value = calloc(1, type->size);
+
+    if (pack_struct_layout(name, type, value) != true
+     || foreign_call_append_value(call, type, value) != true) {
+        free(value);
+        free(name);
+        return false;
+    }
+
+    free(name);
+    return true;
+}
+
+// A sized type is passed as a pointer to a copy of the value, e.g.
+// hex:4:deadbeef, or zeroed if there is no value, e.g. hex:20. The call owns
+// the copy, which is released with the call.
+static bool foreign_call_append_sized(struct foreign_call *call, const char *parameter)
+{
+    void **buffers;
+    void *buffer;
+    void **value;
+    size_t size;
+
+    if (decode_sized_type(parameter, &size, NULL) != true) {
+        builtin_error("failed to decode type from parameter %s", parameter);
+        return false;
+    }
+
+    if (!(buffer = calloc(1, size))) {
+        builtin_error("failed to allocate %zu bytes for parameter %s", size, parameter);
+        return false;
+    }
+
+    if (decode_sized_type(parameter, &size, buffer) != true) {
+        builtin_error("failed to decode type from parameter %s", parameter);
+        free(buffer);
+        return false;
+    }
+
+    if (!(buffers = realloc(call->buffers, (call->nbuffers + 1) * sizeof(void *)))) {
+        free(buffer);
+        return false;
+    }
+
+    call->buffers = buffers;
+    call->buffers[call->nbuffers++] = buffer;
+
+    value   = malloc(sizeof(void *));
+    *value  = buffer;
+
+    if (foreign_call_append_value(call, &ffi_type_pointer, value) != true) {
+        free(value);
+        return false;
+    }
+
+    return true;
+}
+
+// Decode a prefixed parameter, e.g. int:1 and add it to the call.
+bool foreign_call_append(struct foreign_call *call, const char *parameter)
+{
+    ffi_type *type;
+    void *value;
+
+    if (strncmp(parameter, "struct:", strlen("struct:")) == 0) {
+        return foreign_call_append_struct(call, parameter + strlen("struct:"));
+    }
+
+    if (sized_type_prefix(parameter)) {
+        return foreign_call_append_sized(call, parameter);
+    }
+
+    if (decode_primitive_type(parameter, &value, &type) != true) {
+        builtin_error("failed to decode type from parameter %s", parameter);
+        return false;
+    }
+
+    if (foreign_call_append_value(call, type, value) != true) {
+        free(value);
+        return false;
+    }
+
+    return true;
+}
+
+#if (defined(__x86_64__) && !defined(_WIN64)) || (defined(__aarch64__) && !defined(__APPLE__))
+# define HAVE_CALL_STUBS
+#endif
+
+#ifdef HAVE_CALL_STUBS
+// Most calls only use integer and pointer parameters, which on these ABIs are
+// all passed in general purpose registers, so a cast to a function taking
+// intptr_t parameters is equivalent. This is much faster than ffi_call, which
+// has to classify every parameter on every call.
+//
+// The function may be variadic, e.g. printf, and on x86_64 a variadic callee
+// expects %al to hold the number of vector registers used, so the stubs call
+// through a variadic prototype and the compiler sets it. This is harmless for
+// other functions. Apple's arm64 ABI passes variadic parameters on the stack,
+// so stubs are not used there.
+#define MAX_STUB_ARGS 6
+
+typedef intptr_t (*call_stub_t)(void *func, intptr_t *args);
+typedef intptr_t (*variadic_func_t)(intptr_t, ...);
+
+// A variadic function always has at least one named parameter.
+static intptr_t call_stub0(void *func, intptr_t *a)
+{
+    return ((intptr_t (*)(void)) func)();
+}
+
+static intptr_t call_stub1(void *func, intptr_t *a)
+{
+    return ((variadic_func_t) func)(a[0]);
+}
+
+static intptr_t call_stub2(void *func, intptr_t *a)
+{
+    return ((variadic_func_t) func)(a[0], a[1]);
+}
+
+static intptr_t call_stub3(void *func, intptr_t *a)
+{
+    return ((variadic_func_t) func)(a[0], a[1], a[2]);
+}
+
+static intptr_t call_stub4(void *func, intptr_t *a)
+{
+    return ((variadic_func_t) func)(a[0], a[1], a[2], a[3]);
+}
+
+static intptr_t call_stub5(void *func, intptr_t *a)
+{
+    return ((variadic_func_t) func)(a[0], a[1], a[2], a[3], a[4]);
+}
+
+static intptr_t call_stub6(void *func, intptr_t *a)
+{
+    return ((variadic_func_t) func)(a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+static const call_stub_t call_stubs[MAX_STUB_ARGS + 1] = {
+    call_stub0,
+    call_stub1,
+    call_stub2,
+    call_stub3,
+    call_stub4,
+    call_stub5,
+    call_stub6,
+};
+
+// Check if type is passed and returned in a general purpose register.
+static bool stub_compatible_type(ffi_type *type)
+{
+    switch (type->type) {
+        case FFI_TYPE_INT:
+        case FFI_TYPE_UINT8:
+        case FFI_TYPE_SINT8:
+        case FFI_TYPE_UINT16:
+        case FFI_TYPE_SINT16:
+        case FFI_TYPE_UINT32:
+        case FFI_TYPE_SINT32:
+        case FFI_TYPE_UINT64:
+        case FFI_TYPE_SINT64:
+        case FFI_TYPE_POINTER:
+            return true;
+    }
+
+    return false;
+}
+
+// Load a parameter into a register sized value, extended as the ABI requires.
+static intptr_t stub_load_value(ffi_type *type, void *value)
+{
+    switch (type->type) {
+        case FFI_TYPE_INT:      return *(int *) value;
+        case FFI_TYPE_UINT8:    return *(uint8_t *) value;
+        case FFI_TYPE_SINT8:    return *(int8_t *) value;
+        case FFI_TYPE_UINT16:   return *(uint16_t *) value;
+        case FFI_TYPE_SINT16:   return *(int16_t *) value;
+        case FFI_TYPE_UINT32:   return *(uint32_t *) value;
+        case FFI_TYPE_SINT32:   return *(int32_t *) value;
+    }
+
+    return *(intptr_t *) value;
+}
+
+// Store a return value exactly as ffi_call would, i.e. widened to an ffi_arg.
+static void stub_store_value(ffi_type *type, void *retval, intptr_t value)
+{
+    switch (type->type) {
+        case FFI_TYPE_VOID:     break;
+        case FFI_TYPE_INT:      *(ffi_sarg *) retval = (int) value; break;
+        case FFI_TYPE_UINT8:    *(ffi_arg *) retval = (uint8_t) value; break;
+        case FFI_TYPE_SINT8:    *(ffi_sarg *) retval = (int8_t) value; break;
+        case FFI_TYPE_UINT16:   *(ffi_arg *) retval = (uint16_t) value; break;
+        case FFI_TYPE_SINT16:   *(ffi_sarg *) retval = (int16_t) value; break;
+        case FFI_TYPE_UINT32:   *(ffi_arg *) retval = (uint32_t) value; break;
+        case FFI_TYPE_SINT32:   *(ffi_sarg *) retval = (int32_t) value; break;
+        default:                *(intptr_t *) retval = value; break;
+    }
+}
+
+// Find a specialized stub for this call, or NULL if it must use libffi.
+static void * find_call_stub(struct foreign_call *call)
+{
+    if (call->nargs > MAX_STUB_ARGS)
+        return NULL;
+
+    if (call->rettype != &ffi_type_void && !stub_compatible_type(call->rettype))
+        return NULL;
+
+    for (unsigned i = 0; i < call->nargs; i++) {
+        if (!stub_compatible_type(call->argtypes[i]))
+            return NULL;
+    }
+
+    return call_stubs[call->nargs];
+}
+#else
+static void * find_call_stub(struct foreign_call *call)
+{
+    return NULL;
+}
+#endif
+
+bool foreign_call_prepare(struct foreign_call *call)
+{
+    if (call->retval == NULL) {
+        builtin_error("failed to allocate space for return value");
+        return false;
+    }
+
+    if (ffi_prep_cif(&call->cif,
+                     FFI_DEFAULT_ABI,
+                     call->nargs,
+                     call->rettype,
+                     call->argtypes) != FFI_OK) {
+        builtin_error("failed to prepare call interface");
+        return false;
+    }
+
+    // The cif is still required, it's used by dlchain and for struct types.
+    if (!call->generic) {
+        call->stub = find_call_stub(call);
+    }
+
+    return true;
+}
+
+// Call with the specified parameters and return value storage rather than
+// those in the call, so a prepared call can be reused concurrently.
+//
+// This doesn't touch any shell state, so can be called from any thread.
+void foreign_call_dispatch(struct foreign_call *call, void *retval, void **values)
+{
+#ifdef HAVE_CALL_STUBS
+    intptr_t args[MAX_STUB_ARGS];
+
+    if (call->stub) {
+        for (unsigned i = 0; i < call->nargs; i++)
+            args[i] = stub_load_value(call->argtypes[i], values[i]);
+
+        stub_store_value(call->rettype, retval, ((call_stub_t) call->stub)(call->func, args));
+        return;
+    }
+#endif
+
+    ffi_call(&call->cif, call->func, retval, values);
+}
+
+void foreign_call_invoke(struct foreign_call *call)
+{
+    foreign_call_dispatch(call, call->retval, call->values);
+}
+
+// Encode a return value as a prefixed type, or NULL if no return type was
+// requested. The caller should free the result. Structures are unpacked into
+// their layout instead, and NULL is returned.
+char * foreign_call_encode(struct foreign_call *call, void *retval)
+{
+    if (call->layout) {
+        unpack_struct_layout(call->layout, call->rettype, retval);
+        return NULL;
+    }
+
+    if (call->format == NULL)
+        return NULL;
+
+    return encode_primitive_type(call->format, call->rettype, retval);
+}
+
+char * foreign_call_result(struct foreign_call *call)
+{
+    return foreign_call_encode(call, call->retval);
+}
+
+void foreign_call_release(struct foreign_call *call)
+{
+    for (unsigned i = 0; i < call->nargs; i++)
+        free(call->values[i]);
+
+    for (unsigned i = 0; i < call->nbuffers; i++)
+        free(call->buffers[i]);
+
+    free(call->buffers);
+    free(call->values);
+    free(call->argtypes);
+    free(call->retval);
+    free(call->layout);
+
+    call->nargs     = 0;
+    call->nbuffers  = 0;
+    call->buffers   = NULL;
+    call->values    = NULL;
+    call->argtypes  = NULL;
+    call->retval    = NULL;
+    call->layout    = NULL;
+}
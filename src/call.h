@@ -0,0 +1,37 @@
+#ifndef __CALL_H
+#define __CALL_H
+
+// A foreign call that has been resolved and decoded, but not yet executed.
+// This is what dlcall builds from it's parameters, it's split out so that
+// calls can be prepared on the shell thread and executed elsewhere.
+struct foreign_call {
+    void *func;
+    ffi_cif cif;
+    ffi_type *rettype;
+    char *format;           // Format to encode result, NULL if not required.
+    char *layout;           // Layout for a structure result, or NULL.
+    unsigned nargs;
+    ffi_type **argtypes;
+    void **values;
+    void *retval;           // Storage for the return value.
+    void *stub;             // Specialized stub to use instead of ffi_call.
+    void **buffers;         // Copies of sized type parameters, e.g. hex:4.
+    unsigned nbuffers;
+    bool generic;           // Always use ffi_call, set before preparing.
+};
+
+bool foreign_call_decode_return(const char *prefix, ffi_type **rettype, char **format, char **layout);
+void foreign_call_init(struct foreign_call *call, void *func, ffi_type *rettype, char *format, char *layout);
+bool foreign_call_append(struct foreign_call *call, const char *parameter);
+bool foreign_call_append_value(struct foreign_call *call, ffi_type *type, void *value);
+bool foreign_call_prepare(struct foreign_call *call);
+void foreign_call_dispatch(struct foreign_call *call, void *retval, void **values);
+void foreign_call_invoke(struct foreign_call *call);
+char * foreign_call_encode(struct foreign_call *call, void *retval);
+char * foreign_call_result(struct foreign_call *call);
+void foreign_call_release(struct foreign_call *call);
+
+// Hand a prepared call to the worker pool, see async.c.
+int submit_foreign_call(struct foreign_call *call, const char *resultname, const char *jobname);
+
+#endif
@@ -21,6 +21,9 @@
 #include "execute_cmd.h"
 #include "util.h"
 #include "types.h"
+#include "stats.h"
+#include "probes.h"
+#include "trace.h"
 #include "shell.h"
 
 // This function gains control when native code calls a callback we generated.
@@ -34,13 +37,22 @@ static void execute_bash_trampoline(ffi_cif *cif, void *retval, void **args, voi
 {
     SHELL_VAR *function;
     WORD_LIST *params;
+    struct stats_timer timer;
     char *result;
     char **proto = uarg;
+    uint64_t start;
+    uint64_t traced;
+    int status;
     int i;
 
+    stats_start(&timer);
+
+    traced = trace_begin();
+
     // The first entry in proto is the name of the bash function.
     if (!(function = find_function(*proto))) {
         fprintf(stderr, "error: unable to resolve function %s during callback\n", *proto);
+        trace_end("callback", *proto, cif->nargs, traced, EXECUTION_FAILURE);
         return;
     }
 
@@ -65,7 +77,21 @@ static void execute_bash_trampoline(ffi_cif *cif, void *retval, void **args, voi
     params = make_word_list(make_word(result), params);
     params = make_word_list(make_word(*proto), params);
 
-    execute_shell_function(function, params);
+    stats_mark(&timer, STATS_DECODE);
+
+    PROBE2(callback_entry, *proto, cif->nargs);
+
+    start = PROBE_ENABLED(callback_return) ? stats_clock() : 0;
+
+    status = execute_shell_function(function, params);
+
+    if (PROBE_ENABLED(callback_return))
+        PROBE2(callback_return, *proto, stats_clock() - start);
+
+    stats_mark(&timer, STATS_CALL);
+    stats_commit(&timer, *proto);
+
+    trace_end("callback", *proto, cif->nargs, traced, status);
 
     free(result);
     return;
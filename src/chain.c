@@ -0,0 +1,283 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ffi.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "arrayfunc.h"
+#include "common.h"
+#include "util.h"
+#include "types.h"
+#include "call.h"
+#include "shell.h"
+
+// A parameter that refers to the result of an earlier call, e.g. $0.
+struct chain_ref {
+    unsigned arg;
+    unsigned step;
+};
+
+struct chain_step {
+    struct foreign_call call;
+    struct chain_ref *refs;
+    unsigned nrefs;
+};
+
+// Check if this parameter is a symbolic reference to an earlier result.
+static bool parse_chain_ref(const char *parameter, unsigned long *step)
+{
+    if (*parameter != '$')
+        return false;
+
+    return check_parse_ulong(parameter + 1, step);
+}
+
+// Parse one call from the chain, i.e. everything up to the next ; separator.
+// On success, *plist is left pointing at the separator, or NULL if this was
+// the final call.
+//
+//  [-r type] [-h handle] symbol [parameters...]
+//
+static bool parse_chain_step(WORD_LIST **plist, struct chain_step *steps, unsigned nsteps)
+{
+    struct chain_step *step = &steps[nsteps];
+    WORD_LIST *list = *plist;
+    ffi_type *rettype;
+    void *handle;
+    void *func;
+    void *value;
+    char *format;
+    char *layout;
+    unsigned long ref;
+
+    rettype = &ffi_type_void;
+    format  = NULL;
+    layout  = NULL;
+    handle  = RTLD_DEFAULT;
+
+    for (; list && *list->word->word == '-'; list = list->next->next) {
+        if (list->next == NULL) {
+            builtin_error("option %s requires an argument", list->word->word);
+            goto cleanup;
+        }
+
+        if (strcmp(list->word->word, "-r") == 0) {
+            free(layout);
+            if (foreign_call_decode_return(list->next->word->word, &rettype, &format, &layout) != true) {
+                builtin_warning("failed to parse return type");
+                return false;
+            }
+        } else if (strcmp(list->word->word, "-h") == 0) {
+            if (check_parse_ulong(list->next->word->word, (void *) &handle) == 0) {
+                builtin_warning("handle %s is not well-formed", list->next->word->word);
+                goto cleanup;
+            }
+        } else {
+            builtin_error("unrecognised option %s in call %u", list->word->word, nsteps);
+            goto cleanup;
+        }
+    }
+
+    if (list == NULL || strcmp(list->word->word, ";") == 0) {
+        builtin_error("call %u does not specify a symbol", nsteps);
+        goto cleanup;
+    }
+
+    if (!(func = dlsym(handle, list->word->word))) {
+        builtin_warning("failed to resolve symbol %s, %s", list->word->word, dlerror());
+        goto cleanup;
+    }
+
+    foreign_call_init(&step->call, func, rettype, format, layout);
+
+    for (list = list->next; list && strcmp(list->word->word, ";") != 0; list = list->next) {
+        if (!parse_chain_ref(list->word->word, &ref)) {
+            if (foreign_call_append(&step->call, list->word->word) != true)
+                goto error;
+            continue;
+        }
+
+        // The result must already exist, and have a type.
+        if (ref >= nsteps || steps[ref].call.rettype == &ffi_type_void) {
+            builtin_error("%s in call %u does not refer to an earlier result", list->word->word, nsteps);
+            goto error;
+        }
+
+        // The value is filled in from the result of the earlier call just
+        // before this call is executed.
+        value = calloc(1, steps[ref].call.rettype->size);
+        step->refs = realloc(step->refs, (step->nrefs + 1) * sizeof(struct chain_ref));
+        step->refs[step->nrefs].arg  = step->call.nargs;
+        step->refs[step->nrefs].step = ref;
+        step->nrefs++;
+
+        if (foreign_call_append_value(&step->call, steps[ref].call.rettype, value) != true) {
+            free(value);
+            goto error;
+        }
+    }
+
+    if (foreign_call_prepare(&step->call) != true)
+        goto error;
+
+    *plist = list;
+    return true;
+
+  error:
+    foreign_call_release(&step->call);
+    free(step->refs);
+    return false;
+
+  cleanup:
+    free(layout);
+    return false;
+}
+
+// Usage:
+//
+// dlchain [-n name] [-a array] call [\; call...]
+//
+static int execute_call_chain(WORD_LIST *list)
+{
+    struct chain_step *steps;
+    struct chain_step *step;
+    unsigned nsteps;
+    char *resultname;
+    char *arrayname;
+    char *retval;
+    SHELL_VAR *array;
+    int result;
+
+    resultname  = "DLRETVAL";
+    arrayname   = NULL;
+    array       = NULL;
+    steps       = NULL;
+    nsteps      = 0;
+    result      = EXECUTION_FAILURE;
+
+    // This can't use internal_getopt, because the options for the first call
+    // would be consumed too.
+    for (; list && list->next; list = list->next->next) {
+        if (strcmp(list->word->word, "-n") == 0) {
+            resultname = list->next->word->word;
+        } else if (strcmp(list->word->word, "-a") == 0) {
+            arrayname = list->next->word->word;
+        } else {
+            break;
+        }
+    }
+
+    if (list == NULL) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    // Decode every call before executing any of them, so that a mistake in
+    // the chain doesn't leave it half executed.
+    while (list) {
+        steps = realloc(steps, (nsteps + 1) * sizeof(struct chain_step));
+
+        memset(&steps[nsteps], 0, sizeof(struct chain_step));
+
+        if (parse_chain_step(&list, steps, nsteps) != true)
+            goto cleanup;
+
+        nsteps++;
+
+        // Skip the separator.
+        if (list)
+            list = list->next;
+    }
+
+    if (arrayname) {
+        array = make_new_array_variable(arrayname);
+    }
+
+    for (unsigned i = 0; i < nsteps; i++) {
+        step = &steps[i];
+
+        // Substitute any results this call needs.
+        for (unsigned r = 0; r < step->nrefs; r++) {
+            memcpy(step->call.values[step->refs[r].arg],
+                   steps[step->refs[r].step].call.retval,
+                   steps[step->refs[r].step].call.rettype->size);
+        }
+
+        foreign_call_invoke(&step->call);
+
+        if (array && (retval = foreign_call_result(&step->call))) {
+            bind_array_element(array, i, retval, 0);
+            free(retval);
+        }
+    }
+
+    // Only the final result is bound by default.
+    if ((retval = foreign_call_result(&steps[nsteps - 1].call))) {
+        if (interactive_shell) {
+            fprintf(stderr, "%s\n", retval);
+        }
+
+        bind_variable(resultname, retval, 0);
+        free(retval);
+    }
+
+    result = EXECUTION_SUCCESS;
+
+  cleanup:
+    for (unsigned i = 0; i < nsteps; i++) {
+        foreign_call_release(&steps[i].call);
+        free(steps[i].refs);
+    }
+
+    free(steps);
+    return result;
+}
+
+static char *dlchain_usage[] = {
+    "Execute a sequence of native calls in one command.",
+    "",
+    "Common idioms like allocate, fill, call, free require several dlcall",
+    "commands, with intermediate pointers converted to strings and back",
+    "again. dlchain executes a list of calls separated by `;`, and later",
+    "calls can refer to the result of earlier calls as $0, $1, and so on.",
+    "References have the return type of the call they refer to, and must be",
+    "quoted so that bash doesn't expand them.",
+    "",
+    "Each call is specified exactly like a dlcall command, but only the -r",
+    "and -h options are recognised. Every call is decoded before any are",
+    "executed. The options to dlchain itself must come first.",
+    "",
+    "The result of the final call is stored in DLRETVAL, unless otherwise",
+    "specified.",
+    "",
+    "Usage:",
+    "",
+    "    $ dlchain -a r -r pointer calloc 1 64                  \\; \\",
+    "                   -r pointer strcpy '$0' \"hello, world\" \\; \\",
+    "                   -r long strlen '$1'                    \\; \\",
+    "                   free '$0'",
+    "    $ echo ${r[2]}",
+    "    long:12",
+    "",
+    "Options:",
+    "    -n var      Use var instead of DLRETVAL to store the final result.",
+    "    -a array    Store the result of every call in the indexed array.",
+    "",
+    "Exit Status:",
+    "The return code is zero, unless the chain could not be decoded.",
+    NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) dlchain_struct = {
+    .name       = "dlchain",
+    .function   = execute_call_chain,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = dlchain_usage,
+    .short_doc  = "dlchain [-n name] [-a array] [-r type] [-h handle] symbol [parameters...] [\\; ...]",
+    .handle     = NULL,
+};
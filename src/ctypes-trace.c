@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+// Decode a trace log written by ctypes.so when CTYPES_TRACE is set, see
+// trace.c. The output is either a timeline, with nested invocations indented,
+// or a Chrome trace that can be loaded into chrome://tracing or Perfetto.
+//
+//  $ CTYPES_TRACE=script.trace bash script.sh
+//  $ ctypes-trace script.trace | sort -k2 -n -r | head
+//  $ ctypes-trace -c script.trace > script.json
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: ctypes-trace [-c] [-p pid] tracefile\n");
+    fprintf(stderr, "    -c      Print a Chrome trace in JSON format.\n");
+    fprintf(stderr, "    -p pid  Only print invocations from process pid.\n");
+}
+
+static int compare_records(const void *a, const void *b)
+{
+    const struct trace_record *x = a;
+    const struct trace_record *y = b;
+
+    if (x->timestamp != y->timestamp)
+        return x->timestamp < y->timestamp ? -1 : 1;
+
+    // Enclosing invocations first.
+    return (int) x->depth - (int) y->depth;
+}
+
+// Print a fixed size name field, which may not be terminated, as a JSON string.
+static void print_json_string(const char *s, size_t size)
+{
+    putchar('"');
+
+    for (size_t i = 0; i < size && s[i]; i++) {
+        if (s[i] == '"' || s[i] == '\\') {
+            printf("\\%c", s[i]);
+        } else if ((unsigned char) s[i] < ' ') {
+            printf("\\u%04x", s[i]);
+        } else {
+            putchar(s[i]);
+        }
+    }
+
+    putchar('"');
+}
+
+static void print_timeline(struct trace_record *records, size_t count, uint64_t epoch)
+{
+    printf("%12s %12s %8s  %s\n", "start(us)", "duration(us)", "pid", "builtin");
+
+    for (size_t i = 0; i < count; i++) {
+        struct trace_record *record = &records[i];
+
+        printf("%12.3f %12.3f %8d  %*s%.*s",
+               (record->timestamp - epoch) / 1000.0,
+               record->duration / 1000.0,
+               record->pid,
+               record->depth * 2, "",
+               (int) sizeof record->builtin, record->builtin);
+
+        if (record->symbol[0])
+            printf(" %.*s", (int) sizeof record->symbol, record->symbol);
+
+        printf(" (%" PRIu32 " args) = %" PRId32 "\n", record->nargs, record->result);
+    }
+}
+
+static void print_chrome_trace(struct trace_record *records, size_t count, uint64_t epoch)
+{
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    for (size_t i = 0; i < count; i++) {
+        struct trace_record *record = &records[i];
+
+        printf("%s\n{\"name\":", i ? "," : "");
+
+        if (record->symbol[0]) {
+            print_json_string(record->symbol, sizeof record->symbol);
+        } else {
+            print_json_string(record->builtin, sizeof record->builtin);
+        }
+
+        printf(",\"cat\":");
+        print_json_string(record->builtin, sizeof record->builtin);
+        printf(",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+               (record->timestamp - epoch) / 1000.0,
+               record->duration / 1000.0,
+               record->pid,
+               record->pid);
+        printf(",\"args\":{\"nargs\":%" PRIu32 ",\"result\":%" PRId32 "}}",
+               record->nargs,
+               record->result);
+    }
+
+    printf("\n]}\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct trace_header *header;
+    struct trace_record *records;
+    struct trace_record *ring;
+    struct stat st;
+    uint64_t first;
+    size_t count;
+    size_t n;
+    bool chrome;
+    pid_t pid;
+    int opt;
+    int fd;
+
+    chrome  = false;
+    pid     = 0;
+
+    while ((opt = getopt(argc, argv, "cp:h")) != -1) {
+        switch (opt) {
+            case 'c':
+                chrome = true;
+                break;
+            case 'p':
+                pid = strtol(optarg, NULL, 0);
+                break;
+            default:
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if ((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "ctypes-trace: failed to open %s, %m\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    if (st.st_size < sizeof *header
+     || (header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "ctypes-trace: %s is not a trace log\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    close(fd);
+
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof TRACE_MAGIC) != 0
+     || header->version != TRACE_VERSION
+     || header->record_size != sizeof *records
+     || header->capacity == 0
+     || st.st_size < sizeof *header + header->capacity * sizeof *records) {
+        fprintf(stderr, "ctypes-trace: %s is not a compatible trace log\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    ring = (struct trace_record *)(header + 1);
+
+    // When the ring has wrapped, the oldest record follows the newest.
+    if (header->count > header->capacity) {
+        fprintf(stderr, "ctypes-trace: %" PRIu64 " older records were overwritten\n",
+                header->count - header->capacity);
+        count = header->capacity;
+        first = header->count % header->capacity;
+    } else {
+        count = header->count;
+        first = 0;
+    }
+
+    records = calloc(count ? count : 1, sizeof *records);
+
+    for (size_t i = n = 0; i < count; i++) {
+        struct trace_record *record = &ring[(first + i) % header->capacity];
+
+        if (pid && record->pid != pid)
+            continue;
+
+        records[n++] = *record;
+    }
+
+    // Records are written when an invocation returns, put them in the order
+    // they started.
+    qsort(records, n, sizeof *records, compare_records);
+
+    if (chrome) {
+        print_chrome_trace(records, n, n ? records[0].timestamp : 0);
+    } else {
+        print_timeline(records, n, n ? records[0].timestamp : 0);
+    }
+
+    free(records);
+    munmap(header, st.st_size);
+    return EXIT_SUCCESS;
+}
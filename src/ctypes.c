@@ -18,8 +18,16 @@
 #include "arrayfunc.h"
 #include "common.h"
 #include "bashgetopt.h"
+#include "make_cmd.h"
+#include "dispose_cmd.h"
 #include "util.h"
 #include "types.h"
+#include "call.h"
+#include "unpack.h"
+#include "layout.h"
+#include "stats.h"
+#include "probes.h"
+#include "trace.h"
 #include "shell.h"
 
 static void __attribute__((constructor)) init(void)
@@ -203,6 +211,8 @@ static int open_dynamic_library(WORD_LIST *list)
     }
 
     // Now list->word is the library name.
+    trace_symbol(list->word->word);
+
     if (!(handle = dlopen(list->word->word, flags))) {
         builtin_error("dlopen(\"%s\", %#x) failed, %s", list->word->word, flags, dlerror());
         return 1;
@@ -276,6 +286,8 @@ static int get_symbol_address(WORD_LIST *list)
         return EX_USAGE;
     }
 
+    trace_symbol(list->word->word);
+
     if (!(symbol = dlsym(handle, list->word->word))) {
         builtin_warning("failed to resolve symbol %s, %s", list->word->word, dlerror());
         return EXECUTION_FAILURE;
@@ -299,45 +311,176 @@ static int get_symbol_address(WORD_LIST *list)
     return EXECUTION_SUCCESS;
 }
 
+// An out parameter is scratch storage passed to the function by reference,
+// which is decoded into a variable after the call returns, e.g.
+//
+//  out:int=var         An int, stored in var as a prefixed type.
+//  out:hex:20=var      20 bytes, stored in var as a sized type.
+//  out:struct:stat=var A struct stat, unpacked into the layout var.
+//
+struct out_parameter {
+    char *name;         // Variable to store the result, NULL for DLOUT.
+    char *sized;        // A sized type, e.g. hex:20.
+    ffi_type *type;     // Type of a primitive, NULL for a struct.
+    char *format;
+    size_t size;
+    void *storage;
+};
+
+// Parse the part of an out parameter after "out:".
+static bool decode_out_parameter(const char *parameter, struct out_parameter *out)
+{
+    const char *name;
+    char *spec;
+
+    memset(out, 0, sizeof *out);
+
+    // An optional variable name follows the type.
+    if ((name = strchr(parameter, '='))) {
+        spec        = strndupa(parameter, name - parameter);
+        out->name   = strdup(name + 1);
+    } else {
+        spec        = strdupa(parameter);
+    }
+
+    if (strncmp(spec, "struct:", strlen("struct:")) == 0) {
+        spec += strlen("struct:");
+
+        // The layout defaults to a variable named after the struct.
+        if (out->name == NULL) {
+            out->name = strdup(spec);
+        }
+
+        if (find_or_make_struct_layout(spec, out->name) != true) {
+            goto error;
+        }
+
+        // Layouts created by struct record the size, including any trailing
+        // padding.
+        if (prefixed_array_size(out->name, &out->size) != true) {
+            builtin_error("unable to calculate the size of layout %s", out->name);
+            goto error;
+        }
+
+        return true;
+    }
+
+    if (sized_type_prefix(spec)) {
+        if (decode_sized_type(spec, &out->size, NULL) != true) {
+            goto error;
+        }
+
+        out->sized = strdup(spec);
+        return true;
+    }
+
+    if (decode_type_prefix(spec, NULL, &out->type, NULL, &out->format) != true) {
+        goto error;
+    }
+
+    out->size = out->type->size;
+    return true;
+
+  error:
+    free(out->name);
+    out->name = NULL;
+    return false;
+}
+
+// Store the values of out parameters after a call has returned.
+static int bind_out_parameters(struct out_parameter *outs, unsigned nouts)
+{
+    SHELL_VAR *dlout;
+    arrayind_t index;
+    char *value;
+    int result;
+
+    dlout   = NULL;
+    index   = 0;
+    result  = EXECUTION_SUCCESS;
+
+    for (unsigned i = 0; i < nouts; i++) {
+        if (outs[i].sized) {
+            value = encode_sized_type(outs[i].sized, outs[i].storage, &outs[i].size);
+        } else if (outs[i].type == NULL) {
+            if (unpack_prefixed_memory(outs[i].name, outs[i].storage) != EXECUTION_SUCCESS) {
+                result = EXECUTION_FAILURE;
+            }
+            continue;
+        } else {
+            value = encode_primitive_type(outs[i].format, outs[i].type, outs[i].storage);
+        }
+
+        if (outs[i].name) {
+            bind_variable(outs[i].name, value, 0);
+        } else {
+            // Unnamed primitives are stored in order in DLOUT.
+            if (dlout == NULL && (dlout = find_or_make_array_variable("DLOUT", 1))) {
+                array_flush(array_cell(dlout));
+            }
+
+            if (dlout) {
+                bind_array_element(dlout, index++, value, 0);
+            }
+        }
+
+        free(value);
+    }
+
+    return result;
+}
+
 // Usage:
 //
 // dlcall "printf" "hello %s %u %c" $USER 123 int:10
 //
 static int call_foreign_function(WORD_LIST *list)
 {
-    unsigned nargs;
-    unsigned i;
     int opt;
-    ffi_cif cif;
-    ffi_type **argtypes;
+    struct foreign_call call;
+    struct out_parameter *outs;
+    struct stats_timer timer;
+    unsigned nouts;
     ffi_type *rettype;
-    void **values;
     void *handle;
+    void **value;
     void *func;
     char *prefix;
     char *format;
+    char *layout;
     char *resultname;
+    char *jobname;
+    char *retval;
+    char *symbol;
+    bool generic;
+    int result;
+    uint64_t start;
 
-    nargs       = 0;
-    argtypes    = NULL;
-    values      = NULL;
+    stats_start(&timer);
+
+    generic     = false;
     format      = NULL;
+    layout      = NULL;
     prefix      = NULL;
+    jobname     = NULL;
+    outs        = NULL;
+    nouts       = 0;
     rettype     = &ffi_type_void;
     resultname  = "DLRETVAL";
     handle      = RTLD_DEFAULT;
 
     reset_internal_getopt();
 
-    // $ dlcall [-a abi] [-r type] [-n name] [-h handle] symbol args...
-    while ((opt = internal_getopt(list, "h:a:r:n:")) != -1) {
+    // $ dlcall [-a abi] [-r type] [-n name] [-h handle] [-A job] [-F] symbol args...
+    while ((opt = internal_getopt(list, "h:a:r:n:A:F")) != -1) {
         switch (opt) {
             case 'a':
                 builtin_warning("FIXME: only abi %u is currently supported", FFI_DEFAULT_ABI);
                 return 1;
                 break;
             case 'r':
-                if (decode_type_prefix(prefix = list_optarg, NULL, &rettype, NULL, &format) != true) {
+                free(layout);
+                if (foreign_call_decode_return(prefix = list_optarg, &rettype, &format, &layout) != true) {
                     builtin_warning("failed to parse return type");
                     return 1;
                 }
@@ -348,10 +491,18 @@ static int call_foreign_function(WORD_LIST *list)
             case 'h':
                 if (check_parse_ulong(list_optarg, (void *) &handle) == 0) {
                     builtin_warning("handle %s %p is not well-formed", list_optarg, handle);
+                    free(layout);
                     return EXECUTION_FAILURE;
                 }
                 break;
+            case 'A':
+                jobname = list_optarg;
+                break;
+            case 'F':
+                generic = true;
+                break;
             default:
+                free(layout);
                 builtin_usage();
                 return EX_USAGE;
         }
@@ -359,66 +510,126 @@ static int call_foreign_function(WORD_LIST *list)
 
     // Skip past any options.
     if ((list = loptend) == NULL) {
+        free(layout);
         builtin_usage();
         return EX_USAGE;
     }
 
-    if (!(func = dlsym(handle, list->word->word))) {
+    trace_symbol(symbol = list->word->word);
+
+    if (!(func = dlsym(handle, symbol))) {
         builtin_warning("failed to resolve symbol %s, %s", list->word->word, dlerror());
+        free(layout);
         return 1;
     }
 
+    foreign_call_init(&call, func, rettype, format, layout);
+
+    call.generic = generic;
+
     // Skip to optional parameters
-    list = list->next;
+    for (list = list->next; list; list = list->next) {
+        if (strncmp(list->word->word, "out:", strlen("out:")) != 0) {
+            if (foreign_call_append(&call, list->word->word) != true) {
+                goto error;
+            }
+            continue;
+        }
 
-    while (list) {
-        argtypes = realloc(argtypes, (nargs + 1) * sizeof(ffi_type *));
-        values   = realloc(values, (nargs + 1) * sizeof(void *));
+        // This is an out parameter, the size is chosen by the caller so the
+        // storage is on the heap, and released after the results are bound.
+        outs = realloc(outs, (nouts + 1) * sizeof(struct out_parameter));
 
-        if (decode_primitive_type(list->word->word, &values[nargs], &argtypes[nargs]) != true) {
-            builtin_error("failed to decode type from parameter %s", list->word->word);
+        if (decode_out_parameter(list->word->word + strlen("out:"), &outs[nouts]) != true) {
+            builtin_error("failed to decode out parameter %s", list->word->word);
             goto error;
         }
 
-        nargs++;
-        list = list->next;
+        if (!(outs[nouts].storage = calloc(1, outs[nouts].size))) {
+            builtin_error("failed to allocate %zu bytes for out parameter %s",
+                          outs[nouts].size,
+                          list->word->word);
+            free(outs[nouts].name);
+            free(outs[nouts].sized);
+            goto error;
+        }
+
+        value   = malloc(sizeof(void *));
+        *value  = outs[nouts].storage;
+
+        nouts++;
+
+        if (foreign_call_append_value(&call, &ffi_type_pointer, value) != true) {
+            free(value);
+            goto error;
+        }
+    }
+
+    if (foreign_call_prepare(&call) != true) {
+        goto error;
     }
 
-    if (ffi_prep_cif(&cif, FFI_DEFAULT_ABI, nargs, rettype, argtypes) == FFI_OK) {
-        char *retval;
-        void *rc = alloca(rettype->size);
+    // If this is an asynchronous call, the worker pool takes ownership and
+    // the result is collected later with dlwait.
+    if (jobname) {
+        if (nouts) {
+            builtin_error("out parameters cannot be used with asynchronous calls");
+            goto error;
+        }
+
+        return submit_foreign_call(&call, resultname, jobname);
+    }
 
-        // Do the call.
-        ffi_call(&cif, func, rc, values);
+    stats_mark(&timer, STATS_DECODE);
 
-        // Decode the result.
-        if (format) {
-            retval = encode_primitive_type(format, rettype, rc);
+    PROBE2(dlcall_entry, symbol, call.nargs);
 
-            // If this is an interactive shell, print the output.
-            if (interactive_shell) {
-                fprintf(stderr, "%s\n", retval);
-            }
+    start = PROBE_ENABLED(dlcall_return) ? stats_clock() : 0;
+
+    // Do the call.
+    foreign_call_invoke(&call);
 
-            // Save the result to the requested location.
-            bind_variable(resultname, retval, 0);
+    if (PROBE_ENABLED(dlcall_return))
+        PROBE2(dlcall_return, symbol, stats_clock() - start);
 
-            // Bash maintains its own copy of this string, so we can throw it away.
-            free(retval);
+    stats_mark(&timer, STATS_CALL);
+
+    // Decode the result.
+    if ((retval = foreign_call_result(&call))) {
+        // If this is an interactive shell, print the output.
+        if (interactive_shell) {
+            fprintf(stderr, "%s\n", retval);
         }
+
+        // Save the result to the requested location.
+        bind_variable(resultname, retval, 0);
+
+        // Bash maintains its own copy of this string, so we can throw it away.
+        free(retval);
     }
 
-    for (i = 0; i < nargs; i++)
-        free(values[i]);
-    free(values);
-    free(argtypes);
-    return 0;
+    result = bind_out_parameters(outs, nouts);
+
+    for (unsigned i = 0; i < nouts; i++) {
+        free(outs[i].name);
+        free(outs[i].sized);
+        free(outs[i].storage);
+    }
+    free(outs);
+    foreign_call_release(&call);
+
+    stats_mark(&timer, STATS_BIND);
+    stats_commit(&timer, symbol);
+    return result;
 
   error:
-    for (i = 0; i < nargs; i++)
-        free(values[i]);
-    free(values);
-    free(argtypes);
+    for (unsigned i = 0; i < nouts; i++) {
+        free(outs[i].name);
+        free(outs[i].sized);
+        free(outs[i].storage);
+    }
+    free(outs);
+    foreign_call_release(&call);
     return 1;
 }
 
@@ -458,11 +669,70 @@ static char *dlcall_usage[] = {
     "    $ dlopen libc.so.6",
     "    $ dlcall lchown string:/tmp/foo int:$UID int:-1",
     "",
+    "A region of bytes can be passed as a single value with the sized types",
+    "hex, base64 and chars, which are followed by the size, then the value.",
+    "A pointer to a temporary copy is passed, zeroed if there is no value.",
+    "",
+    "    $ dlcall -r int memcmp hex:4:deadbeef base64:4:3q2+7w== 4",
+    "",
+    "Out Parameters",
+    "",
+    "Many functions return values through pointers. Rather than allocating a",
+    "buffer, calling, unpacking and freeing, you can use an out parameter.",
+    "Temporary storage is passed to the function, and decoded into a variable",
+    "after it returns:",
+    "",
+    "    out:type=var           A primitive type, stored in var.",
+    "    out:hex:size=var       A sized type, e.g. hex:20, stored in var.",
+    "    out:struct:name=var    A structure, unpacked into the layout var.",
+    "",
+    "If var is omitted for a primitive, the values are stored in order in the",
+    "array DLOUT. If var is omitted for a structure, a variable named after",
+    "the structure is used. If the layout doesn't exist, it is created with",
+    "the struct command, otherwise any array usable with unpack will do.",
+    "",
+    "    $ dlcall -r int stat /etc/passwd out:struct:stat=passwd",
+    "    $ dlcall -r int getaddrinfo string:$host string:80 $NULL out:pointer=res",
+    "    $ fds=(int int)",
+    "    $ dlcall pipe out:struct:fds=fds",
+    "",
+    "Structures By Value",
+    "",
+    "A few functions take or return structures by value rather than by",
+    "reference. The layout uses the same syntax as out parameters, and is",
+    "packed into a temporary structure or unpacked from the result:",
+    "",
+    "    struct:name=var        Pass the layout var as a struct name.",
+    "    -r struct:name=var     Unpack the returned struct name into var.",
+    "",
+    "Padding members are ignored, ffi calculates the structure layout from",
+    "the types of the remaining members.",
+    "",
+    "    $ div_t=(int int)",
+    "    $ dlcall -r struct:div_t div int:7 int:2",
+    "    $ echo ${div_t[@]}",
+    "    int:3 int:1",
+    "",
     "Options:",
     "    -a abi      Use the specified ABI rather than the default.",
-    "    -r type     The function returns the specified type (default: void).",
+    "    -r type     The function returns the specified type (default: void),",
+    "                or a structure as struct:name=var.",
     "    -n var      Use var instead of DLRETVAL to store the result.",
-    "    -h handle   Use handle instead of RTLD_DEFAULT (Usually ${DLRETVAL[soname]})."
+    "    -h handle   Use handle instead of RTLD_DEFAULT (Usually ${DLRETVAL[soname]}).",
+    "    -A job      Run the call asynchronously, storing a job identifier in job.",
+    "    -F          Always use libffi, even if a faster specialized stub exists.",
+    "",
+    "Asynchronous Calls",
+    "",
+    "Slow or blocking routines (connect, getaddrinfo, read, etc) can be",
+    "dispatched to a pool of native threads with -A. dlcall returns",
+    "immediately, and the result is collected later with dlwait.",
+    "",
+    "    $ dlcall -A job -r int -n ret connect $sfd $addr $addrlen",
+    "    $ dlwait job",
+    "    $ echo $ret",
+    "",
+    "See `help dlwait` for more.",
     "",
     NULL,
 };
@@ -600,7 +870,7 @@ struct builtin __attribute__((visibility("default"))) dlcall_struct = {
     .function   = call_foreign_function,
     .flags      = BUILTIN_ENABLED,
     .long_doc   = dlcall_usage,
-    .short_doc  = "dlcall [-n name] [-a abi] [-r type] [-h handle] symbol [parameters...]",
+    .short_doc  = "dlcall [-n name] [-a abi] [-r type] [-h handle] [-A job] [-F] symbol [parameters...]",
     .handle     = NULL,
 };
 
@@ -0,0 +1,837 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ffi.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "arrayfunc.h"
+#include "common.h"
+#include "make_cmd.h"
+#include "dispose_cmd.h"
+#include "util.h"
+#include "types.h"
+#include "unpack.h"
+#include "layout.h"
+#include "shell.h"
+
+// A layout is a prefixed array or associative array, as used by pack and
+// unpack, that describes some native memory. The routines here convert
+// layouts into ffi structure types, so that structures can be passed and
+// returned by value.
+//
+// Layouts created by the struct command record the offset of each member, see
+// layout_offsets_bind(), so pack and unpack can address members directly.
+// Other layouts are consecutive, and may use __pad members to model compiler
+// padding, these are skipped here because ffi calculates member offsets
+// itself.
+struct layout_type {
+    ffi_type type;
+    size_t *offsets;
+    unsigned count;
+    struct layout_type *next;
+};
+
+// Generating a structure type is relatively expensive, so every distinct
+// layout is only done once.
+static struct layout_type *layouts;
+
+// Sized members, e.g. chars:108, are arrays of bytes. ffi has no array type,
+// instead an array is a structure with one element for every byte. These are
+// shared by size, so that identical layouts have identical elements.
+struct byte_array_type {
+    ffi_type type;
+    struct byte_array_type *next;
+};
+
+static struct byte_array_type *byte_arrays;
+
+struct slot_context {
+    char ***slots;
+    unsigned count;
+};
+
+static int collect_element_slot(ARRAY_ELEMENT *element, void *user)
+{
+    struct slot_context *ctx = user;
+
+    ctx->slots = realloc(ctx->slots, (ctx->count + 1) * sizeof(char **));
+    ctx->slots[ctx->count++] = &element->value;
+    return 0;
+}
+
+static int collect_element_slot_assoc(BUCKET_CONTENTS *element, void *user)
+{
+    struct slot_context *ctx = user;
+
+    // Padding is calculated by ffi.
+    if (strstr(element->key, ".__pad"))
+        return 0;
+
+    ctx->slots = realloc(ctx->slots, (ctx->count + 1) * sizeof(char **));
+    ctx->slots[ctx->count++] = (char **) &element->data;
+    return 0;
+}
+
+// Find the location of every member value in the layout name, in order.
+static char *** collect_layout_slots(const char *name, unsigned *count)
+{
+    struct slot_context ctx = {0};
+    SHELL_VAR *var;
+
+    if (!(var = find_variable(name)) || invisible_p(var)) {
+        builtin_error("%s is not a layout, check `help struct`", name);
+        return NULL;
+    }
+
+    if (assoc_p(var)) {
+        assoc_walk_data(assoc_cell(var), collect_element_slot_assoc, &ctx);
+    } else if (array_p(var)) {
+        array_walk(array_cell(var), collect_element_slot, &ctx);
+    } else {
+        builtin_error("expected an array or associative array");
+        return NULL;
+    }
+
+    if (ctx.count == 0) {
+        builtin_error("the layout %s has no members", name);
+        free(ctx.slots);
+        return NULL;
+    }
+
+    *count = ctx.count;
+    return ctx.slots;
+}
+
+// Return an ffi type for an array of size bytes.
+static ffi_type * byte_array_type(size_t size)
+{
+    struct byte_array_type *array;
+
+    for (array = byte_arrays; array; array = array->next) {
+        if (array->type.size == size)
+            return &array->type;
+    }
+
+    if (!(array = calloc(1, sizeof *array))
+     || !(array->type.elements = calloc(size + 1, sizeof(ffi_type *)))) {
+        builtin_error("failed to allocate a type for %zu bytes", size);
+        free(array);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < size; i++)
+        array->type.elements[i] = &ffi_type_uint8;
+
+    array->type.type        = FFI_TYPE_STRUCT;
+    array->type.size        = size;
+    array->type.alignment   = 1;
+    array->next             = byte_arrays;
+
+    byte_arrays = array;
+    return &array->type;
+}
+
+// Decode the type of a layout member, ignoring any value, e.g. int:1234. Sized
+// members have no format.
+static bool decode_member_type(const char *member, ffi_type **type, char **format)
+{
+    char *prefix;
+    size_t size;
+
+    if (sized_type_prefix(member)) {
+        if (decode_sized_type(member, &size, NULL) != true
+         || (*type = byte_array_type(size)) == NULL)
+            return false;
+
+        if (format)
+            *format = NULL;
+
+        return true;
+    }
+
+    prefix = strchr(member, ':')
+           ? strndupa(member, strchr(member, ':') - member)
+           : (char *) member;
+
+    return decode_type_prefix(prefix, NULL, type, NULL, format);
+}
+
+// Make sure name is a layout, creating it with the struct command if
+// necessary.
+bool find_or_make_struct_layout(const char *structname, const char *name)
+{
+    sh_builtin_func_t *generate_struct;
+    SHELL_VAR *var;
+    WORD_LIST *words;
+    int result;
+
+    if ((var = find_variable(name)) && (array_p(var) || assoc_p(var))) {
+        return true;
+    }
+
+    if (!(generate_struct = find_shell_builtin("struct"))) {
+        builtin_error("%s is not a layout, and automatic struct support is not available", name);
+        return false;
+    }
+
+    words   = make_word_list(make_word(structname), make_word_list(make_word(name), NULL));
+    result  = generate_struct(words);
+
+    dispose_words(words);
+
+    return result == EXECUTION_SUCCESS;
+}
+
+// Return an ffi structure type matching the layout name.
+ffi_type * layout_struct_type(const char *name)
+{
+    struct layout_type *layout;
+    ffi_type **elements;
+    unsigned count;
+    char ***slots;
+    ffi_cif cif;
+    size_t offset;
+
+    if (!(slots = collect_layout_slots(name, &count)))
+        return NULL;
+
+    // The elements array must be NULL terminated.
+    elements = calloc(count + 1, sizeof(ffi_type *));
+
+    for (unsigned i = 0; i < count; i++) {
+        if (decode_member_type(*slots[i], &elements[i], NULL) != true) {
+            builtin_error("the layout %s contains an unrecognised type %s", name, *slots[i]);
+            goto error;
+        }
+
+        if (elements[i] == &ffi_type_void) {
+            builtin_error("the layout %s cannot contain void", name);
+            goto error;
+        }
+    }
+
+    free(slots);
+
+    // Check if we've seen this layout before.
+    for (layout = layouts; layout; layout = layout->next) {
+        if (layout->count == count
+         && memcmp(layout->type.elements, elements, count * sizeof(ffi_type *)) == 0) {
+            free(elements);
+            return &layout->type;
+        }
+    }
+
+    layout                  = calloc(1, sizeof *layout);
+    layout->count           = count;
+    layout->offsets         = calloc(count, sizeof(size_t));
+    layout->type.type       = FFI_TYPE_STRUCT;
+    layout->type.elements   = elements;
+
+    // Preparing a cif is the portable way to have ffi calculate the size and
+    // alignment of a structure.
+    if (ffi_prep_cif(&cif, FFI_DEFAULT_ABI, 0, &layout->type, NULL) != FFI_OK) {
+        builtin_error("failed to generate a structure type for %s", name);
+        free(layout->offsets);
+        free(layout);
+        free(elements);
+        return NULL;
+    }
+
+    for (unsigned i = offset = 0; i < count; i++) {
+        offset  = (offset + elements[i]->alignment - 1) & ~(elements[i]->alignment - 1);
+        layout->offsets[i] = offset;
+        offset += elements[i]->size;
+    }
+
+    layout->next    = layouts;
+    layouts         = layout;
+
+    return &layout->type;
+
+  error:
+    free(slots);
+    free(elements);
+    return NULL;
+}
+
+// Parse the part of a struct prefix after "struct:", which is the name of the
+// structure, and optionally the name of the layout variable, e.g.
+// div_t=result. If the layout name is omitted, it's the structure name.
+bool decode_struct_prefix(const char *spec, char **name, ffi_type **type)
+{
+    const char *var;
+    char *structname;
+
+    if ((var = strchr(spec, '='))) {
+        structname  = strndupa(spec, var - spec);
+        *name       = strdup(var + 1);
+    } else {
+        structname  = (char *) spec;
+        *name       = strdup(spec);
+    }
+
+    if (find_or_make_struct_layout(structname, *name) != true
+     || (*type = layout_struct_type(*name)) == NULL) {
+        free(*name);
+        *name = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+static struct layout_type * layout_from_type(const char *name, ffi_type *type, unsigned count)
+{
+    struct layout_type *layout = (struct layout_type *) type;
+
+    // The layout could have been modified since the type was generated.
+    if (layout->count != count) {
+        builtin_error("the layout %s has changed", name);
+        return NULL;
+    }
+
+    return layout;
+}
+
+// Pack the values in layout name into dest, which must be type->size bytes.
+bool pack_struct_layout(const char *name, ffi_type *type, void *dest)
+{
+    struct layout_type *layout;
+    ffi_type *valuetype;
+    unsigned count;
+    char ***slots;
+    void *value;
+
+    if (!(slots = collect_layout_slots(name, &count)))
+        return false;
+
+    if (!(layout = layout_from_type(name, type, count)))
+        goto error;
+
+    for (unsigned i = 0; i < count; i++) {
+        size_t size;
+
+        // Sized members are decoded in place, they must be exactly the size
+        // of the element.
+        if (sized_type_prefix(*slots[i])) {
+            if (decode_sized_type(*slots[i], &size, NULL) != true
+             || size != type->elements[i]->size
+             || decode_sized_type(*slots[i], &size, (uint8_t *) dest + layout->offsets[i]) != true) {
+                builtin_warning("aborted pack at bad type prefix %s (%s)", *slots[i], name);
+                goto error;
+            }
+
+            continue;
+        }
+
+        // Members without a value are zero, as with pack.
+        if (strchr(*slots[i], ':') == NULL) {
+            if (decode_type_prefix(*slots[i], "0", &valuetype, &value, NULL) != true)
+                goto error;
+        } else if (decode_primitive_type(*slots[i], &value, &valuetype) != true) {
+            builtin_warning("aborted pack at bad type prefix %s (%s)", *slots[i], name);
+            goto error;
+        }
+
+        if (valuetype->size != type->elements[i]->size) {
+            builtin_error("the value %s does not match the layout %s", *slots[i], name);
+            free(value);
+            goto error;
+        }
+
+        memcpy((uint8_t *) dest + layout->offsets[i], value, valuetype->size);
+        free(value);
+    }
+
+    free(slots);
+    return true;
+
+  error:
+    free(slots);
+    return false;
+}
+
+// Unpack source, which must be type->size bytes, into the layout name.
+bool unpack_struct_layout(const char *name, ffi_type *type, void *source)
+{
+    struct layout_type *layout;
+    ffi_type *membertype;
+    unsigned count;
+    char ***slots;
+    char *format;
+
+    if (!(slots = collect_layout_slots(name, &count)))
+        return false;
+
+    if (!(layout = layout_from_type(name, type, count)))
+        goto error;
+
+    for (unsigned i = 0; i < count; i++) {
+        char *value;
+        size_t size;
+
+        if (decode_member_type(*slots[i], &membertype, &format) != true)
+            goto error;
+
+        if (membertype->size != type->elements[i]->size) {
+            builtin_error("the layout %s has changed", name);
+            goto error;
+        }
+
+        if (sized_type_prefix(*slots[i])) {
+            value = encode_sized_type(*slots[i], (uint8_t *) source + layout->offsets[i], &size);
+        } else {
+            value = encode_primitive_type(format, membertype, (uint8_t *) source + layout->offsets[i]);
+        }
+
+        // Discard previous value
+        free(*slots[i]);
+
+        *slots[i] = value;
+    }
+
+    free(slots);
+    return true;
+
+  error:
+    free(slots);
+    return false;
+}
+
+// The offsets of layouts created by struct are recorded here, rather than in
+// the layout, so they never appear as members. Bash has no hook for unset, so
+// each is checked against the variable and its hash table when it's used,
+// and stale offsets are released when another layout is recorded. A copy of
+// a layout is a different variable, and has no offsets.
+struct layout_offsets {
+    char *name;
+    SHELL_VAR *var;
+    HASH_TABLE *table;
+    size_t size;                // Size of the record, including any padding.
+    char *offsets;              // The offset of every member, e.g. " a:0 b:8".
+    struct layout_offsets *next;
+};
+
+static struct layout_offsets *recorded;
+
+// Check that the variable the offsets were recorded for still exists. It may
+// have been unset, and a new variable created at the same address, but only
+// struct creates tables with a single bucket.
+static bool layout_offsets_valid(struct layout_offsets *layout)
+{
+    SHELL_VAR *var = find_variable(layout->name);
+
+    return var == layout->var
+        && assoc_p(var)
+        && !invisible_p(var)
+        && assoc_cell(var) == layout->table
+        && layout->table->nbuckets == 1;
+}
+
+static void layout_offsets_free(struct layout_offsets *layout)
+{
+    free(layout->name);
+    free(layout->offsets);
+    free(layout);
+}
+
+// Release the offsets of layouts that have gone, or that are being replaced
+// by var.
+static void release_stale_offsets(SHELL_VAR *var)
+{
+    struct layout_offsets **layout;
+    struct layout_offsets *stale;
+
+    for (layout = &recorded; *layout;) {
+        if ((*layout)->var == var || layout_offsets_valid(*layout) != true) {
+            stale   = *layout;
+            *layout = stale->next;
+            layout_offsets_free(stale);
+            continue;
+        }
+
+        layout = &(*layout)->next;
+    }
+}
+
+// Append the offset of member to offsets, which should be freed by the caller.
+void layout_offsets_add(char **offsets, const char *member, size_t offset)
+{
+    char *result;
+
+    asprintf(&result, "%s %s:%zu", *offsets ? *offsets : "", member, offset);
+    free(*offsets);
+    *offsets = result;
+}
+
+// Record offsets for the layout var, with the size of the record, including
+// any trailing padding.
+bool layout_offsets_bind(SHELL_VAR *var, const char *offsets, size_t size)
+{
+    struct layout_offsets *layout;
+
+    release_stale_offsets(var);
+
+    if (!(layout = calloc(1, sizeof *layout)))
+        return false;
+
+    layout->name    = strdup(var->name);
+    layout->var     = var;
+    layout->table   = assoc_cell(var);
+    layout->size    = size;
+    layout->offsets = strdup(offsets ? offsets : "");
+    layout->next    = recorded;
+
+    if (!layout->name || !layout->offsets) {
+        layout_offsets_free(layout);
+        return false;
+    }
+
+    recorded = layout;
+    return true;
+}
+
+// Return the recorded offsets of a layout, or NULL if it doesn't have any.
+static struct layout_offsets * find_layout_offsets(SHELL_VAR *var)
+{
+    for (struct layout_offsets *layout = recorded; layout; layout = layout->next) {
+        if (layout->var == var)
+            return layout_offsets_valid(layout) ? layout : NULL;
+    }
+
+    return NULL;
+}
+
+// If entry is the offset of member, e.g. " member:8", store the offset and
+// return the next entry. Otherwise return NULL.
+static const char * match_member_offset(const char *entry, const char *member, size_t *offset)
+{
+    size_t length = strlen(member);
+    char *end;
+
+    if (strncmp(entry + 1, member, length) != 0 || entry[length + 1] != ':')
+        return NULL;
+
+    *offset = strtoul(entry + length + 2, &end, 10);
+    return end;
+}
+
+// Return true if the layout name has recorded offsets.
+bool layout_has_offsets(const char *name)
+{
+    SHELL_VAR *var;
+
+    return (var = find_variable(name)) && find_layout_offsets(var);
+}
+
+// Return the size of a record described by the layout name, if it's known.
+bool layout_record_size(const char *name, size_t *size)
+{
+    struct layout_offsets *layout;
+    SHELL_VAR *var;
+
+    if (!(var = find_variable(name)) || !(layout = find_layout_offsets(var)))
+        return false;
+
+    *size = layout->size;
+    return true;
+}
+
+struct member_context {
+    struct layout_member *members;
+    const char *offsets;        // Recorded offsets, or NULL.
+    const char *next;           // The entry after the last offset found.
+    size_t size;                // Size of the record, if offsets are recorded.
+    unsigned count;
+    size_t offset;
+    bool valid;
+};
+
+// Find the recorded offset of member. Members are usually walked in the order
+// they were recorded, so the entry after the previous member is tried first.
+static bool find_member_offset(struct member_context *ctx, const char *member, size_t *offset)
+{
+    const char *entry;
+    const char *next;
+
+    if (*ctx->next && (next = match_member_offset(ctx->next, member, offset))) {
+        ctx->next = next;
+        return true;
+    }
+
+    for (entry = strchr(ctx->offsets, ' '); entry; entry = strchr(entry + 1, ' ')) {
+        if ((next = match_member_offset(entry, member, offset))) {
+            ctx->next = next;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Start looking up offsets in the layout var, if it has any.
+static void member_context_init(struct member_context *ctx, SHELL_VAR *var)
+{
+    struct layout_offsets *layout;
+
+    if (!(layout = find_layout_offsets(var)))
+        return;
+
+    ctx->offsets    = layout->offsets;
+    ctx->next       = layout->offsets;
+    ctx->size       = layout->size;
+}
+
+// Add a member with the type element, e.g. int, int:1234 or hex:4:00000000.
+static int collect_member(struct member_context *ctx, const char *name, char **element)
+{
+    struct layout_member *member;
+    const char *colon;
+
+    ctx->members = realloc(ctx->members, (ctx->count + 1) * sizeof *ctx->members);
+    member = memset(&ctx->members[ctx->count], 0, sizeof *member);
+
+    if (sized_type_prefix(*element)) {
+        if (decode_sized_type(*element, &member->size, NULL) != true)
+            goto error;
+
+        // Keep the size, e.g. hex:4.
+        colon        = strchr(strchr(*element, ':') + 1, ':');
+        member->type = colon ? strndup(*element, colon - *element) : strdup(*element);
+    } else {
+        colon        = strchr(*element, ':');
+        member->type = colon ? strndup(*element, colon - *element) : strdup(*element);
+
+        if (decode_type_prefix(member->type, NULL, &member->ffitype, NULL, &member->format) != true) {
+            free(member->type);
+            goto error;
+        }
+
+        member->size = member->ffitype->size;
+    }
+
+    // Use the recorded offset, if there is one.
+    if (ctx->offsets) {
+        if (find_member_offset(ctx, name, &ctx->offset) != true) {
+            builtin_error("the member %s has no recorded offset, use struct again", name);
+            free(member->type);
+            goto error;
+        }
+
+        if (ctx->offset > ctx->size || member->size > ctx->size - ctx->offset) {
+            builtin_error("the member %s does not fit in the record", name);
+            free(member->type);
+            goto error;
+        }
+    }
+
+    member->name    = strdup(name);
+    member->value   = element;
+    member->offset  = ctx->offset;
+    member->padding = strstr(name, "__pad") != NULL;
+    member->selected = !member->padding;
+    ctx->offset    += member->size;
+    ctx->count++;
+    return 0;
+
+  error:
+    ctx->valid = false;
+    return -1;
+}
+
+static int collect_element_member(ARRAY_ELEMENT *element, void *user)
+{
+    char index[32];
+
+    snprintf(index, sizeof index, "%jd", (intmax_t) element->ind);
+    return collect_member(user, index, &element->value);
+}
+
+static int collect_element_member_assoc(BUCKET_CONTENTS *element, void *user)
+{
+    return collect_member(user, element->key, (char **) &element->data);
+}
+
+// Describe every member of the layout name, in order, with the offset that
+// pack and unpack would use. Members are consecutive, unless the layout was
+// created by struct.
+struct layout_member * layout_members(const char *name, unsigned *count)
+{
+    struct member_context ctx = { .valid = true };
+    SHELL_VAR *var;
+
+    if (!(var = find_variable(name)) || invisible_p(var)) {
+        builtin_error("%s is not a layout, check `help struct`", name);
+        return NULL;
+    }
+
+    member_context_init(&ctx, var);
+
+    if (assoc_p(var)) {
+        assoc_walk_data(assoc_cell(var), collect_element_member_assoc, &ctx);
+    } else if (array_p(var)) {
+        array_walk(array_cell(var), collect_element_member, &ctx);
+    } else {
+        builtin_error("expected an array or associative array");
+        return NULL;
+    }
+
+    if (!ctx.valid) {
+        builtin_error("the layout %s is not valid", name);
+        free_layout_members(ctx.members, ctx.count);
+        return NULL;
+    }
+
+    if (ctx.count == 0) {
+        builtin_error("the layout %s has no members", name);
+        free(ctx.members);
+        return NULL;
+    }
+
+    *count = ctx.count;
+    return ctx.members;
+}
+
+// Describe only the members named in the comma separated list fields, which
+// is much faster than layout_members() for large structures. This is only
+// possible if the layout was created by struct, and every field is the name
+// of a member, otherwise NULL is returned.
+struct layout_member * layout_named_members(const char *name, const char *fields, unsigned *count)
+{
+    struct member_context ctx = { .valid = true };
+    BUCKET_CONTENTS *item;
+    SHELL_VAR *var;
+    char *list = strdupa(fields);
+    char *field;
+
+    if (!(var = find_variable(name)) || invisible_p(var) || !find_layout_offsets(var))
+        return NULL;
+
+    member_context_init(&ctx, var);
+
+    while ((field = strsep(&list, ","))) {
+        struct member_context probe = ctx;
+        size_t offset;
+
+        // Check quietly for an offset first, collect_member() reports errors.
+        if (!(item = hash_search(field, assoc_cell(var), 0))
+         || find_member_offset(&probe, field, &offset) != true
+         || collect_member(&ctx, field, (char **) &item->data) != 0) {
+            free_layout_members(ctx.members, ctx.count);
+            return NULL;
+        }
+    }
+
+    *count = ctx.count;
+    return ctx.members;
+}
+
+// Select only the members named in the comma separated list fields. A nested
+// structure or array selects all of its members, e.g. st_mtim selects
+// st_mtim.tv_sec and st_mtim.tv_nsec.
+bool select_layout_members(struct layout_member *members, unsigned count, const char *fields)
+{
+    char *list = strdupa(fields);
+    char *field;
+    bool found;
+
+    for (unsigned i = 0; i < count; i++)
+        members[i].selected = false;
+
+    while ((field = strsep(&list, ","))) {
+        size_t length = strlen(field);
+
+        found = false;
+
+        for (unsigned i = 0; i < count; i++) {
+            const char *name = members[i].name;
+
+            if (strncmp(name, field, length) == 0
+             && (name[length] == '\0' || name[length] == '.' || name[length] == '[')) {
+                members[i].selected = true;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            builtin_error("the layout has no member named %s", field);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void free_layout_members(struct layout_member *members, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++) {
+        free(members[i].name);
+        free(members[i].type);
+    }
+
+    free(members);
+}
+
+// Return the value of member in the record at base as a prefixed type, which
+// should be freed by the caller.
+char * encode_layout_member(struct layout_member *member, const void *base)
+{
+    const uint8_t *source = (const uint8_t *) base + member->offset;
+
+    if (member->ffitype == NULL) {
+        size_t size;
+        return encode_sized_type(member->type, source, &size);
+    }
+
+    return encode_primitive_type(member->format, member->ffitype, (void *) source);
+}
+
+// Store value in member of the record at base. The value may be prefixed,
+// e.g. int:1234, or not, in which case it has the type of the member.
+bool decode_layout_member(struct layout_member *member, const char *value, void *base)
+{
+    uint8_t *dest = (uint8_t *) base + member->offset;
+    ffi_type *type;
+    char *element;
+    void *data;
+    size_t size;
+    bool result;
+
+    if (member->ffitype == NULL) {
+        if (sized_type_prefix(value)) {
+            element = strdup(value);
+        } else {
+            asprintf(&element, "%s:%s", member->type, value);
+        }
+
+        if ((result = decode_sized_type(element, &size, NULL)) && size != member->size) {
+            builtin_error("the value %s does not match the member %s", value, member->type);
+            result = false;
+        }
+
+        result = result && decode_sized_type(element, &size, dest);
+        free(element);
+        return result;
+    }
+
+    if (strchr(value, ':')) {
+        if (decode_primitive_type(value, &data, &type) != true)
+            return false;
+    } else if (decode_type_prefix(member->type, value, &type, &data, NULL) != true) {
+        return false;
+    }
+
+    if (type->size != member->size) {
+        builtin_error("the value %s does not match the member %s", value, member->type);
+        free(data);
+        return false;
+    }
+
+    memcpy(dest, data, member->size);
+    free(data);
+    return true;
+}
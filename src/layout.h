@@ -0,0 +1,35 @@
+#ifndef __LAYOUT_H
+#define __LAYOUT_H
+
+bool find_or_make_struct_layout(const char *structname, const char *name);
+bool decode_struct_prefix(const char *spec, char **name, ffi_type **type);
+ffi_type * layout_struct_type(const char *name);
+bool pack_struct_layout(const char *name, ffi_type *type, void *dest);
+bool unpack_struct_layout(const char *name, ffi_type *type, void *source);
+
+// A member of a layout, and where pack and unpack would find it.
+struct layout_member {
+    char *name;         // The key or index of the member.
+    char **value;       // The element in the layout, e.g. int:1234.
+    char *type;         // The type without any value, e.g. int or hex:4.
+    ffi_type *ffitype;  // NULL for sized types.
+    char *format;
+    size_t offset;
+    size_t size;
+    bool padding;
+    bool selected;      // Not padding, or named with -f.
+};
+
+void layout_offsets_add(char **offsets, const char *member, size_t offset);
+bool layout_offsets_bind(SHELL_VAR *var, const char *offsets, size_t size);
+bool layout_has_offsets(const char *name);
+bool layout_record_size(const char *name, size_t *size);
+
+struct layout_member * layout_members(const char *name, unsigned *count);
+struct layout_member * layout_named_members(const char *name, const char *fields, unsigned *count);
+bool select_layout_members(struct layout_member *members, unsigned count, const char *fields);
+void free_layout_members(struct layout_member *members, unsigned count);
+char * encode_layout_member(struct layout_member *member, const void *base);
+bool decode_layout_member(struct layout_member *member, const char *value, void *base);
+
+#endif
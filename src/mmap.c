@@ -0,0 +1,441 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ffi.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "arrayfunc.h"
+#include "common.h"
+#include "bashgetopt.h"
+#include "util.h"
+#include "types.h"
+#include "trace.h"
+#include "shell.h"
+
+// Every mapping made by dlmmap, so that dlmunmap knows the real base and
+// length, and can refuse to unmap memory it didn't create.
+struct mapping {
+    void *base;                 // Page aligned start of the mapping.
+    size_t length;              // Total length, from base.
+    void *address;              // The address returned to the user.
+    int fd;                     // memfd descriptor, or -1.
+    struct mapping *next;
+};
+
+static struct mapping *mappings;
+
+static const struct {
+    const char *name;
+    int advice;
+} advice_names[] = {
+    { "normal",     MADV_NORMAL },
+    { "random",     MADV_RANDOM },
+    { "sequential", MADV_SEQUENTIAL },
+    { "willneed",   MADV_WILLNEED },
+    { "dontneed",   MADV_DONTNEED },
+#ifdef MADV_HUGEPAGE
+    { "hugepage",   MADV_HUGEPAGE },
+    { "nohugepage", MADV_NOHUGEPAGE },
+#endif
+#ifdef MADV_DONTDUMP
+    { "dontdump",   MADV_DONTDUMP },
+#endif
+};
+
+#define NADVICE (sizeof advice_names / sizeof *advice_names)
+#define MAX_ADVICE 8
+
+static bool decode_advice(const char *name, int *advice)
+{
+    for (unsigned i = 0; i < NADVICE; i++) {
+        if (strcmp(advice_names[i].name, name) == 0) {
+            *advice = advice_names[i].advice;
+            return true;
+        }
+    }
+
+    builtin_error("unrecognised advice %s, see `help dlmmap`", name);
+    return false;
+}
+
+// Store the mapping in name as an indexed array of (pointer size [fd]).
+static bool bind_mapping(const char *name, struct mapping *mapping, size_t size)
+{
+    SHELL_VAR *array;
+    char value[128];
+
+    // Replace any existing variable, rather than shadowing it.
+    unbind_variable(name);
+
+    if (!(array = make_new_array_variable((char *) name))) {
+        builtin_error("failed to create array %s", name);
+        return false;
+    }
+
+    snprintf(value, sizeof value, "pointer:%p", mapping->address);
+    bind_array_element(array, 0, value, 0);
+
+    snprintf(value, sizeof value, "%zu", size);
+    bind_array_element(array, 1, value, 0);
+
+    if (mapping->fd != -1) {
+        snprintf(value, sizeof value, "int:%d", mapping->fd);
+        bind_array_element(array, 2, value, 0);
+    }
+
+    return true;
+}
+
+// Usage:
+//
+//  dlmmap [-w] [-c] [-p] [-a advice] [-o offset] [-l length] file var
+//  dlmmap [-p] [-a advice] -l length -A var
+//  dlmmap [-p] [-a advice] -l length -M name var
+//
+static int map_file_region(WORD_LIST *list)
+{
+    struct mapping *mapping;
+    struct stat st;
+    const char *memfd;
+    unsigned long length;
+    unsigned long offset;
+    unsigned nadvice;
+    int advice[MAX_ADVICE];
+    size_t pagesize;
+    size_t delta;
+    bool anonymous;
+    bool writable;
+    bool private;
+    void *base;
+    int flags;
+    int prot;
+    int opt;
+    int fd;
+
+    reset_internal_getopt();
+
+    anonymous   = false;
+    writable    = false;
+    private     = false;
+    memfd       = NULL;
+    nadvice     = 0;
+    length      = 0;
+    offset      = 0;
+    flags       = 0;
+    fd          = -1;
+
+    while ((opt = internal_getopt(list, "wcpa:o:l:AM:")) != -1) {
+        switch (opt) {
+            case 'w':
+                writable = true;
+                break;
+            case 'c':
+                private = true;
+                break;
+            case 'p':
+                flags |= MAP_POPULATE;
+                break;
+            case 'a':
+                if (nadvice == MAX_ADVICE) {
+                    builtin_error("too many -a options");
+                    return EX_USAGE;
+                }
+                if (decode_advice(list_optarg, &advice[nadvice++]) != true)
+                    return EX_USAGE;
+                break;
+            case 'o':
+                if (check_parse_ulong(list_optarg, &offset) != true) {
+                    builtin_error("could not parse offset %s", list_optarg);
+                    return EX_USAGE;
+                }
+                break;
+            case 'l':
+                if (check_parse_ulong(list_optarg, &length) != true || length == 0) {
+                    builtin_error("could not parse length %s", list_optarg);
+                    return EX_USAGE;
+                }
+                break;
+            case 'A':
+                anonymous = true;
+                break;
+            case 'M':
+                memfd = list_optarg;
+                break;
+            default:
+                builtin_usage();
+                return EX_USAGE;
+        }
+    }
+
+    // Skip past any options.
+    if ((list = loptend) == NULL) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    if ((anonymous || memfd) && (list->next || length == 0 || offset)) {
+        builtin_error("anonymous mappings require -l length and a variable name");
+        return EX_USAGE;
+    }
+
+    if (!anonymous && !memfd && !list->next) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    pagesize    = sysconf(_SC_PAGESIZE);
+    delta       = offset % pagesize;
+
+    if (anonymous) {
+        flags  |= MAP_PRIVATE | MAP_ANONYMOUS;
+        prot    = PROT_READ | PROT_WRITE;
+    } else if (memfd) {
+        if ((fd = memfd_create(memfd, MFD_CLOEXEC)) < 0) {
+            builtin_error("memfd_create(\"%s\") failed, %s", memfd, strerror(errno));
+            return EXECUTION_FAILURE;
+        }
+
+        if (ftruncate(fd, length) != 0) {
+            builtin_error("failed to resize memfd %s, %s", memfd, strerror(errno));
+            goto error;
+        }
+
+        flags  |= MAP_SHARED;
+        prot    = PROT_READ | PROT_WRITE;
+    } else {
+        trace_symbol(list->word->word);
+
+        // A private writable mapping does not need write access to the file,
+        // changes are not written back.
+        if ((fd = open(list->word->word, writable && !private ? O_RDWR : O_RDONLY)) < 0) {
+            builtin_error("failed to open %s, %s", list->word->word, strerror(errno));
+            return EXECUTION_FAILURE;
+        }
+
+        if (fstat(fd, &st) != 0) {
+            builtin_error("failed to stat %s, %s", list->word->word, strerror(errno));
+            goto error;
+        }
+
+        if (offset >= st.st_size && length == 0) {
+            builtin_error("%s has no data at offset %lu to map", list->word->word, offset);
+            goto error;
+        }
+
+        // Map the rest of the file by default.
+        if (length == 0)
+            length = st.st_size - offset;
+
+        flags  |= private ? MAP_PRIVATE : MAP_SHARED;
+        prot    = PROT_READ | (writable || private ? PROT_WRITE : 0);
+
+        // The file isn't needed after mapping.
+        list    = list->next;
+    }
+
+    // The offset passed to mmap must be page aligned, so map from the start
+    // of the page and adjust the address.
+    base = mmap(NULL, length + delta, prot, flags, fd, offset - delta);
+
+    if (base == MAP_FAILED) {
+        builtin_error("mmap failed, %s", strerror(errno));
+        goto error;
+    }
+
+    for (unsigned i = 0; i < nadvice; i++) {
+        if (madvise(base, length + delta, advice[i]) != 0) {
+            builtin_warning("madvise failed, %s", strerror(errno));
+        }
+    }
+
+    // Only a memfd is worth keeping open, so that it can be shared.
+    if (fd != -1 && !memfd) {
+        close(fd);
+        fd = -1;
+    }
+
+    mapping             = malloc(sizeof *mapping);
+    mapping->base       = base;
+    mapping->length     = length + delta;
+    mapping->address    = (uint8_t *) base + delta;
+    mapping->fd         = fd;
+    mapping->next       = mappings;
+
+    if (bind_mapping(list->word->word, mapping, length) != true) {
+        munmap(base, mapping->length);
+        free(mapping);
+        goto error;
+    }
+
+    mappings = mapping;
+    return EXECUTION_SUCCESS;
+
+  error:
+    if (fd != -1)
+        close(fd);
+    return EXECUTION_FAILURE;
+}
+
+// Find the address in parameter, which can be a pointer, or the name of a
+// variable created by dlmmap.
+static bool decode_mapping_address(const char *parameter, void **address)
+{
+    ffi_type *type;
+    SHELL_VAR *var;
+    void **value;
+    char *element;
+
+    if (!strchr(parameter, ':')) {
+        if (!(var = find_variable(parameter)) || !array_p(var)) {
+            builtin_error("%s is not a mapping created by dlmmap", parameter);
+            return false;
+        }
+
+        if (!(element = array_reference(array_cell(var), 0))) {
+            builtin_error("%s is not a mapping created by dlmmap", parameter);
+            return false;
+        }
+
+        parameter = element;
+    }
+
+    if (decode_primitive_type(parameter, (void **) &value, &type) != true
+     || type != &ffi_type_pointer) {
+        builtin_error("could not parse pointer %s", parameter);
+        return false;
+    }
+
+    *address = *value;
+    free(value);
+    return true;
+}
+
+// Usage:
+//
+//  dlmunmap var|pointer [...]
+//
+static int unmap_file_region(WORD_LIST *list)
+{
+    struct mapping **mapping;
+    struct mapping *found;
+    void *address;
+    int result;
+
+    if (!list) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    for (result = EXECUTION_SUCCESS; list; list = list->next) {
+        if (decode_mapping_address(list->word->word, &address) != true) {
+            result = EXECUTION_FAILURE;
+            continue;
+        }
+
+        for (mapping = &mappings; *mapping; mapping = &(*mapping)->next) {
+            if ((*mapping)->address == address)
+                break;
+        }
+
+        if (!(found = *mapping)) {
+            builtin_error("%s was not mapped by dlmmap", list->word->word);
+            result = EXECUTION_FAILURE;
+            continue;
+        }
+
+        *mapping = found->next;
+
+        if (munmap(found->base, found->length) != 0) {
+            builtin_warning("munmap failed, %s", strerror(errno));
+        }
+
+        if (found->fd != -1)
+            close(found->fd);
+
+        free(found);
+
+        // The pointer is no longer valid, so discard the variable.
+        if (!strchr(list->word->word, ':'))
+            unbind_variable(list->word->word);
+    }
+
+    return result;
+}
+
+static char *dlmmap_usage[] = {
+    "Map a file into memory.",
+    "",
+    "The file is mapped without copying, and var is set to an indexed array",
+    "containing a pointer to the data and its size in bytes. The pointer can",
+    "be used with unpack or dlcall as normal, and released with dlmunmap.",
+    "",
+    "Usage:",
+    "",
+    "    $ dlmmap -a sequential header.bin hdr",
+    "    $ header=(uint32 uint32 uint64)",
+    "    $ unpack $hdr header",
+    "    $ echo ${hdr[1]} bytes",
+    "    $ dlmunmap hdr",
+    "",
+    "Instead of a file, -A creates anonymous memory, and -M creates a memfd",
+    "that can be shared with other processes. The memfd descriptor is stored",
+    "as a third element, e.g. /proc/$$/fd/${buf[2]##*:}. Both require -l.",
+    "",
+    "    $ dlmmap -l 4096 -M scratch buf",
+    "",
+    "Options:",
+    "    -w          Map writable, changes are written to the file.",
+    "    -c          Map writable, but changes are not written to the file.",
+    "    -p          Populate page tables, reading the file ahead of use.",
+    "    -a advice   Apply madvise advice, one of normal, random, sequential,",
+    "                willneed, dontneed, hugepage or nohugepage.",
+    "    -o offset   Start mapping from offset bytes into the file.",
+    "    -l length   Map length bytes, the default is the rest of the file.",
+    "    -A          Map anonymous memory instead of a file.",
+    "    -M name     Map a new memfd called name instead of a file.",
+    "",
+    "Exit Status:",
+    "The return code is zero, unless the file could not be mapped.",
+    NULL,
+};
+
+static char *dlmunmap_usage[] = {
+    "Unmap memory mapped by dlmmap.",
+    "",
+    "Each parameter is either the name of a variable set by dlmmap, which is",
+    "unset, or the pointer to the mapping. Any memfd is closed.",
+    "",
+    "Usage:",
+    "",
+    "    $ dlmmap data.bin data",
+    "    $ dlmunmap data",
+    "",
+    NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) dlmmap_struct = {
+    .name       = "dlmmap",
+    .function   = map_file_region,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = dlmmap_usage,
+    .short_doc  = "dlmmap [-w] [-c] [-p] [-a advice] [-o offset] [-l length] [-A|-M name] [file] var",
+    .handle     = NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) dlmunmap_struct = {
+    .name       = "dlmunmap",
+    .function   = unmap_file_region,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = dlmunmap_usage,
+    .short_doc  = "dlmunmap var|pointer [...]",
+    .handle     = NULL,
+};
@@ -0,0 +1,10 @@
+#include "probes.h"
+
+#ifdef HAVE_SYS_SDT_H
+// The semaphores referenced by the probe notes, see probes.h.
+# define DEFINE_PROBE_SEMAPHORE(name)                            \
+    unsigned short PROBE_SEMAPHORE(name)                        \
+        __attribute__((section(".probes"), visibility("hidden")));
+
+PROBE_LIST(DEFINE_PROBE_SEMAPHORE)
+#endif
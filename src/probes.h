@@ -0,0 +1,57 @@
+#ifndef __PROBES_H
+#define __PROBES_H
+
+// Static tracepoints for external profilers such as bpftrace, perf and
+// SystemTap, which can attach to a running shell, e.g.
+//
+//  # bpftrace -p $PID -e 'usdt:./ctypes.so:ctypes:dlcall_return {
+//      @[str(arg0)] = hist(arg1);
+//  }'
+//
+// The probes are:
+//
+//  dlcall_entry(symbol, nargs)         Before dlcall or dlbind calls symbol.
+//  dlcall_return(symbol, nanoseconds)  After symbol returns.
+//  callback_entry(function, nargs)     Before a callback executes function.
+//  callback_return(function, nanoseconds)
+//  pack(variable, elements)            After pack or unpack, with the number
+//  unpack(variable, elements)          of elements processed.
+//  dwarf_load_start(library)           Before struct or sizeof search library.
+//  dwarf_load_end(library, found)
+//
+// These are nops unless sys/sdt.h was available at build time, which adds no
+// runtime dependency. Each probe has a semaphore that the tracer increments
+// while attached, so latency is only measured when somebody is listening.
+#define PROBE_LIST(X)       \
+    X(dlcall_entry)         \
+    X(dlcall_return)        \
+    X(callback_entry)       \
+    X(callback_return)      \
+    X(pack)                 \
+    X(unpack)               \
+    X(dwarf_load_start)     \
+    X(dwarf_load_end)
+
+#ifdef HAVE_SYS_SDT_H
+# define _SDT_HAS_SEMAPHORES 1
+# include <sys/sdt.h>
+
+# define PROBE_SEMAPHORE(name) ctypes_ ## name ## _semaphore
+# define DECLARE_PROBE_SEMAPHORE(name)                          \
+    extern unsigned short PROBE_SEMAPHORE(name)                 \
+        __attribute__((unused, section(".probes"), visibility("hidden")));
+
+PROBE_LIST(DECLARE_PROBE_SEMAPHORE)
+
+# define PROBE_ENABLED(name)        __builtin_expect(PROBE_SEMAPHORE(name), 0)
+# define PROBE1(name, a)            DTRACE_PROBE1(ctypes, name, a)
+# define PROBE2(name, a, b)         DTRACE_PROBE2(ctypes, name, a, b)
+#else
+// The arguments are still referenced, so that values only computed for a
+// probe don't become unused variables.
+# define PROBE_ENABLED(name)        0
+# define PROBE1(name, a)            do { (void) (a); } while (0)
+# define PROBE2(name, a, b)         do { (void) (a); (void) (b); } while (0)
+#endif
+
+#endif
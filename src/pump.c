@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <ffi.h>
+#include <inttypes.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "common.h"
+#include "bashgetopt.h"
+#include "util.h"
+#include "types.h"
+#include "call.h"
+#include "shell.h"
+
+#define DEFAULT_PUMP_SIZE (64 * 1024)
+
+// Resolve the consumer, which can either be a symbol name or a function
+// pointer, e.g. one generated by the callback command.
+static void * resolve_consumer(void *handle, const char *name)
+{
+    ffi_type *type;
+    void **value;
+    void *func;
+
+    if (strncmp(name, "pointer:", strlen("pointer:")) == 0) {
+        if (decode_primitive_type(name, (void **) &value, &type) != true)
+            return NULL;
+
+        func = *value;
+        free(value);
+        return func;
+    }
+
+    if (!(func = dlsym(handle, name))) {
+        builtin_warning("failed to resolve symbol %s, %s", name, dlerror());
+        return NULL;
+    }
+
+    return func;
+}
+
+// Usage:
+//
+// dlpump [-f fd] [-b bufsize] [-h handle] [-n name] consumer context
+//
+static int pump_native_consumer(WORD_LIST *list)
+{
+    struct foreign_call call;
+    unsigned long bufsize;
+    uint64_t total;
+    ssize_t count;
+    void *handle;
+    void *func;
+    void *buffer;
+    void **bufarg;
+    size_t *lenarg;
+    char *resultname;
+    char retval[64];
+    long fd;
+    int opt;
+
+    fd          = STDIN_FILENO;
+    bufsize     = DEFAULT_PUMP_SIZE;
+    handle      = RTLD_DEFAULT;
+    resultname  = "DLRETVAL";
+    total       = 0;
+
+    reset_internal_getopt();
+
+    while ((opt = internal_getopt(list, "f:b:h:n:")) != -1) {
+        switch (opt) {
+            case 'f':
+                if (!check_parse_long(list_optarg, &fd) || fd < 0) {
+                    builtin_error("failed to parse `%s`, expected a file descriptor", list_optarg);
+                    return EXECUTION_FAILURE;
+                }
+                break;
+            case 'b':
+                if (!check_parse_ulong(list_optarg, &bufsize) || bufsize == 0) {
+                    builtin_error("failed to parse `%s`, expected a buffer size", list_optarg);
+                    return EXECUTION_FAILURE;
+                }
+                break;
+            case 'h':
+                if (check_parse_ulong(list_optarg, (void *) &handle) == 0) {
+                    builtin_warning("handle %s %p is not well-formed", list_optarg, handle);
+                    return EXECUTION_FAILURE;
+                }
+                break;
+            case 'n':
+                resultname = list_optarg;
+                break;
+            default:
+                builtin_usage();
+                return EX_USAGE;
+        }
+    }
+
+    // Skip past any options, we need a consumer and a context.
+    if ((list = loptend) == NULL || !list->next || list->next->next) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    if (!(func = resolve_consumer(handle, list->word->word))) {
+        return EXECUTION_FAILURE;
+    }
+
+    if (!(buffer = malloc(bufsize))) {
+        builtin_error("failed to allocate a %lu byte buffer", bufsize);
+        return EXECUTION_FAILURE;
+    }
+
+    bufarg  = malloc(sizeof *bufarg);
+    lenarg  = malloc(sizeof *lenarg);
+    *bufarg = buffer;
+
+    // The consumer is called as consumer(context, buffer, length), so the cif
+    // is prepared once and only the length changes between chunks.
+    foreign_call_init(&call, func, &ffi_type_void, NULL, NULL);
+
+    if (foreign_call_append(&call, list->next->word->word) != true) {
+        free(bufarg);
+        free(lenarg);
+        goto error;
+    }
+
+    if (foreign_call_append_value(&call, &ffi_type_pointer, bufarg) != true
+     || foreign_call_append_value(&call, &ffi_type_ulong, lenarg) != true
+     || foreign_call_prepare(&call) != true) {
+        goto error;
+    }
+
+    while (true) {
+        count = read(fd, buffer, bufsize);
+
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+
+            builtin_error("read from fd %ld failed, %s", fd, strerror(errno));
+            goto error;
+        }
+
+        if (count == 0)
+            break;
+
+        *lenarg = count;
+        total  += count;
+
+        foreign_call_invoke(&call);
+    }
+
+    snprintf(retval, sizeof retval, "uint64:%" PRIu64, total);
+
+    if (interactive_shell) {
+        fprintf(stderr, "%s\n", retval);
+    }
+
+    bind_variable(resultname, retval, 0);
+
+    foreign_call_release(&call);
+    free(buffer);
+    return EXECUTION_SUCCESS;
+
+  error:
+    foreign_call_release(&call);
+    free(buffer);
+    return EXECUTION_FAILURE;
+}
+
+static char *dlpump_usage[] = {
+    "Feed data from a file descriptor into a native consumer.",
+    "",
+    "Reads from fd until end of file, calling consumer(context, buffer, length)",
+    "for each chunk read. The data never passes through bash, so this is much",
+    "faster than a loop of dlcall read and dlcall consumer.",
+    "",
+    "The consumer can be a symbol name, or a function pointer such as one",
+    "generated by the callback command. The context is a prefixed parameter",
+    "decoded exactly like a dlcall parameter, the length is a size_t and the",
+    "return value of the consumer is ignored.",
+    "",
+    "The total number of bytes read is stored in DLRETVAL, unless otherwise",
+    "specified.",
+    "",
+    "Usage:",
+    "",
+    "    $ sizeof -am ctx SHA_CTX",
+    "    $ dlcall SHA1_Init $ctx",
+    "    $ dlpump SHA1_Update $ctx < /etc/passwd",
+    "    $ dlcall SHA1_Final $md $ctx",
+    "",
+    "    Copy stdin to stdout via write(1, buffer, length):",
+    "",
+    "    $ dlpump write int:1 < infile > outfile",
+    "",
+    "Options:",
+    "    -f fd       Read from fd instead of stdin.",
+    "    -b size     Read up to size bytes per chunk (default: 65536).",
+    "    -h handle   Use handle instead of RTLD_DEFAULT to resolve consumer.",
+    "    -n var      Use var instead of DLRETVAL to store the byte count.",
+    "",
+    "Exit Status:",
+    "The return code is zero, unless the consumer could not be resolved or",
+    "a read error occurred.",
+    NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) dlpump_struct = {
+    .name       = "dlpump",
+    .function   = pump_native_consumer,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = dlpump_usage,
+    .short_doc  = "dlpump [-f fd] [-b bufsize] [-h handle] [-n name] consumer context",
+    .handle     = NULL,
+};
@@ -0,0 +1,441 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "arrayfunc.h"
+#include "common.h"
+#include "bashgetopt.h"
+#include "util.h"
+#include "unpack.h"
+#include "stats.h"
+#include "shell.h"
+
+// Profiling is opt-in, when disabled the only cost is testing this flag.
+bool stats_enabled;
+
+// Latencies are also recorded in a log-linear histogram, like HdrHistogram.
+// Values below HISTOGRAM_LINEAR are exact, above that every power of two is
+// split into HISTOGRAM_LINEAR equal buckets, so the error is under 1/16th of
+// the value, and a full 64-bit range only needs 976 buckets.
+#define HISTOGRAM_BITS      4
+#define HISTOGRAM_LINEAR    (1 << HISTOGRAM_BITS)
+#define HISTOGRAM_BUCKETS   ((64 - HISTOGRAM_BITS + 1) * HISTOGRAM_LINEAR)
+
+struct phase_stats {
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t histogram[HISTOGRAM_BUCKETS];
+};
+
+// Everything recorded about one symbol (or builtin).
+struct call_stats {
+    char *name;
+    uint64_t calls;
+    struct phase_stats phases[STATS_NPHASES];
+};
+
+// The percentiles reported by dlstat.
+static const struct {
+    const char *name;
+    double fraction;
+} percentiles[] = {
+    { "p50",  0.50  },
+    { "p99",  0.99  },
+    { "p999", 0.999 },
+};
+
+#define NPERCENTILES (sizeof percentiles / sizeof *percentiles)
+
+static const char *phase_names[STATS_NPHASES] = {
+    [STATS_DECODE]  = "decode",
+    [STATS_CALL]    = "call",
+    [STATS_BIND]    = "bind",
+};
+
+// Map of names to struct call_stats.
+static HASH_TABLE *call_stats;
+
+// Nanoseconds since an arbitrary point, for measuring intervals.
+uint64_t stats_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * UINT64_C(1000000000) + now.tv_nsec;
+}
+
+void stats_start(struct stats_timer *timer)
+{
+    memset(timer, 0, sizeof *timer);
+
+    if (stats_enabled) {
+        timer->last = stats_clock();
+    }
+}
+
+// Attribute the time since the last mark to phase.
+void stats_mark(struct stats_timer *timer, enum stats_phase phase)
+{
+    uint64_t now;
+
+    if (!stats_enabled || timer->last == 0)
+        return;
+
+    now                     = stats_clock();
+    timer->elapsed[phase]  += now - timer->last;
+    timer->last             = now;
+}
+
+static struct call_stats * find_call_stats(const char *name)
+{
+    BUCKET_CONTENTS *bucket;
+    struct call_stats *stats;
+
+    if (call_stats == NULL) {
+        call_stats = hash_create(64);
+    }
+
+    if ((bucket = hash_search(name, call_stats, 0))) {
+        return (struct call_stats *) bucket->data;
+    }
+
+    stats       = calloc(1, sizeof *stats);
+    stats->name = strdup(name);
+
+    // The table takes ownership of the key.
+    bucket          = hash_insert(strdup(name), call_stats, 0);
+    bucket->data    = stats;
+
+    return stats;
+}
+
+static unsigned histogram_bucket(uint64_t value)
+{
+    unsigned exponent;
+
+    if (value < HISTOGRAM_LINEAR)
+        return value;
+
+    exponent = 63 - __builtin_clzll(value);
+
+    return (exponent - HISTOGRAM_BITS + 1) * HISTOGRAM_LINEAR
+         + ((value >> (exponent - HISTOGRAM_BITS)) & (HISTOGRAM_LINEAR - 1));
+}
+
+// The largest value that would be recorded in bucket.
+static uint64_t histogram_value(unsigned bucket)
+{
+    unsigned shift;
+
+    if (bucket < HISTOGRAM_LINEAR)
+        return bucket;
+
+    shift = bucket / HISTOGRAM_LINEAR - 1;
+
+    return ((uint64_t) (HISTOGRAM_LINEAR + bucket % HISTOGRAM_LINEAR + 1) << shift) - 1;
+}
+
+// Find the value at or below which fraction of calls completed.
+static uint64_t histogram_percentile(struct phase_stats *phase, uint64_t calls, double fraction)
+{
+    uint64_t target;
+    uint64_t count;
+
+    target = fraction * calls + 0.5;
+    target = target ? target : 1;
+
+    for (unsigned i = count = 0; i < HISTOGRAM_BUCKETS; i++) {
+        if ((count += phase->histogram[i]) >= target) {
+            // Don't exaggerate beyond what was actually recorded.
+            return histogram_value(i) < phase->max ? histogram_value(i) : phase->max;
+        }
+    }
+
+    return phase->max;
+}
+
+// Record a completed call to name.
+void stats_commit(struct stats_timer *timer, const char *name)
+{
+    struct call_stats *stats;
+
+    if (!stats_enabled || timer->last == 0)
+        return;
+
+    stats = find_call_stats(name);
+
+    for (int i = 0; i < STATS_NPHASES; i++) {
+        struct phase_stats *phase = &stats->phases[i];
+
+        if (stats->calls == 0 || timer->elapsed[i] < phase->min)
+            phase->min = timer->elapsed[i];
+        if (timer->elapsed[i] > phase->max)
+            phase->max = timer->elapsed[i];
+
+        phase->total += timer->elapsed[i];
+        phase->histogram[histogram_bucket(timer->elapsed[i])]++;
+    }
+
+    stats->calls++;
+}
+
+static void free_call_stats(PTR_T data)
+{
+    struct call_stats *stats = data;
+
+    free(stats->name);
+    free(stats);
+}
+
+static uint64_t total_time(struct call_stats *stats)
+{
+    uint64_t total = 0;
+
+    for (int i = 0; i < STATS_NPHASES; i++)
+        total += stats->phases[i].total;
+
+    return total;
+}
+
+// Sort by total time, most expensive first.
+static int compare_call_stats(const void *a, const void *b)
+{
+    uint64_t x = total_time(*(struct call_stats **) a);
+    uint64_t y = total_time(*(struct call_stats **) b);
+
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+struct collect_context {
+    struct call_stats **stats;
+    unsigned count;
+};
+
+static int collect_call_stats(BUCKET_CONTENTS *bucket, void *user)
+{
+    struct collect_context *ctx = user;
+
+    ctx->stats[ctx->count++] = bucket->data;
+    return 0;
+}
+
+static void print_call_stats(struct call_stats **stats, unsigned count)
+{
+    char calls[32];
+
+    printf("%-32s %10s  %-6s %14s %12s %12s", "symbol", "calls", "phase", "total(us)", "min(us)", "max(us)");
+
+    for (unsigned n = 0; n < NPERCENTILES; n++)
+        printf(" %8s(us)", percentiles[n].name);
+
+    putchar('\n');
+
+    for (unsigned i = 0; i < count; i++) {
+        snprintf(calls, sizeof calls, "%" PRIu64, stats[i]->calls);
+
+        for (int p = 0; p < STATS_NPHASES; p++) {
+            struct phase_stats *phase = &stats[i]->phases[p];
+
+            printf("%-32s %10s  %-6s %14.3f %12.3f %12.3f",
+                   p == 0 ? stats[i]->name : "",
+                   p == 0 ? calls : "",
+                   phase_names[p],
+                   phase->total / 1000.0,
+                   phase->min / 1000.0,
+                   phase->max / 1000.0);
+
+            for (unsigned n = 0; n < NPERCENTILES; n++) {
+                printf(" %12.3f", histogram_percentile(phase,
+                                                       stats[i]->calls,
+                                                       percentiles[n].fraction) / 1000.0);
+            }
+
+            putchar('\n');
+        }
+    }
+}
+
+static void export_value(SHELL_VAR *assoc, const char *name, const char *key, uint64_t value)
+{
+    char number[32];
+
+    snprintf(number, sizeof number, "%" PRIu64, value);
+
+    // The array takes ownership of the key.
+    bind_assoc_variable(assoc, (char *) name, strdup(key), number, 0);
+}
+
+// Export stats into an associative array, the keys look like strlen.calls,
+// strlen.call.max or strlen.call.p99. Times are in nanoseconds.
+static int export_call_stats(const char *name, struct call_stats **stats, unsigned count)
+{
+    SHELL_VAR *assoc;
+    char key[512];
+
+    if (!(assoc = make_new_assoc_variable((char *) name))) {
+        builtin_error("failed to create associative array %s", name);
+        return EXECUTION_FAILURE;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        snprintf(key, sizeof key, "%s.calls", stats[i]->name);
+        export_value(assoc, name, key, stats[i]->calls);
+
+        for (int p = 0; p < STATS_NPHASES; p++) {
+            struct phase_stats *phase = &stats[i]->phases[p];
+
+            snprintf(key, sizeof key, "%s.%s.total", stats[i]->name, phase_names[p]);
+            export_value(assoc, name, key, phase->total);
+
+            snprintf(key, sizeof key, "%s.%s.min", stats[i]->name, phase_names[p]);
+            export_value(assoc, name, key, phase->min);
+
+            snprintf(key, sizeof key, "%s.%s.max", stats[i]->name, phase_names[p]);
+            export_value(assoc, name, key, phase->max);
+
+            for (unsigned n = 0; n < NPERCENTILES; n++) {
+                snprintf(key, sizeof key, "%s.%s.%s", stats[i]->name, phase_names[p], percentiles[n].name);
+                export_value(assoc, name, key, histogram_percentile(phase,
+                                                                    stats[i]->calls,
+                                                                    percentiles[n].fraction));
+            }
+        }
+    }
+
+    return EXECUTION_SUCCESS;
+}
+
+// Usage:
+//
+// dlstat [-e|-d] [-r] [-a array]
+//
+static int report_call_stats(WORD_LIST *list)
+{
+    struct collect_context ctx = {0};
+    char *arrayname;
+    bool reset;
+    bool print;
+    int result;
+    int opt;
+
+    arrayname   = NULL;
+    reset       = false;
+    print       = true;
+    result      = EXECUTION_SUCCESS;
+
+    reset_internal_getopt();
+
+    while ((opt = internal_getopt(list, "edra:")) != -1) {
+        switch (opt) {
+            case 'e':
+                stats_enabled = true;
+                print = false;
+                break;
+            case 'd':
+                stats_enabled = false;
+                print = false;
+                break;
+            case 'r':
+                reset = true;
+                print = false;
+                break;
+            case 'a':
+                arrayname = list_optarg;
+                print = false;
+                break;
+            default:
+                builtin_usage();
+                return EX_USAGE;
+        }
+    }
+
+    if (loptend != NULL) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    if (call_stats && (print || arrayname)) {
+        ctx.stats = calloc(HASH_ENTRIES(call_stats) + 1, sizeof(struct call_stats *));
+
+        assoc_walk_data(call_stats, collect_call_stats, &ctx);
+
+        qsort(ctx.stats, ctx.count, sizeof(struct call_stats *), compare_call_stats);
+    }
+
+    if (print) {
+        print_call_stats(ctx.stats, ctx.count);
+    }
+
+    if (arrayname) {
+        result = export_call_stats(arrayname, ctx.stats, ctx.count);
+    }
+
+    if (reset && call_stats) {
+        hash_flush(call_stats, free_call_stats);
+    }
+
+    free(ctx.stats);
+    return result;
+}
+
+static char *dlstat_usage[] = {
+    "Report time spent in native calls.",
+    "",
+    "When profiling is enabled with -e, dlcall, dlbind builtins, callbacks,",
+    "pack, unpack and struct record how often they are used, and how long",
+    "they take. The time is split into phases:",
+    "",
+    "    decode      Parsing options and decoding parameters.",
+    "    call        Executing native code.",
+    "    bind        Encoding results and storing them in variables.",
+    "",
+    "Calls are recorded by symbol name, dlbind builtins and callbacks by the",
+    "name of the builtin or bash function, and other commands by their name.",
+    "Asynchronous calls are not recorded.",
+    "",
+    "Every latency is also recorded in a log-linear histogram, accurate to",
+    "within 1/16th of the value, so that the 50th, 99th and 99.9th percentile",
+    "latencies can be reported. Averages hide occasional stalls, the",
+    "percentiles don't.",
+    "",
+    "With no options, a table sorted by total time is printed. Use -a to",
+    "export the statistics into an associative array instead, the keys are",
+    "symbol.calls and symbol.phase.total, symbol.phase.min, symbol.phase.max,",
+    "symbol.phase.p50, symbol.phase.p99 and symbol.phase.p999 in nanoseconds.",
+    "",
+    "Usage:",
+    "",
+    "    $ dlstat -e",
+    "    $ dlcall -r long strlen hello",
+    "    $ dlstat -a stats",
+    "    $ echo ${stats[strlen.calls]}",
+    "    1",
+    "",
+    "Options:",
+    "    -e          Enable profiling.",
+    "    -d          Disable profiling, statistics already recorded are kept.",
+    "    -r          Discard all statistics recorded.",
+    "    -a array    Store statistics in the associative array.",
+    "",
+    "Exit Status:",
+    "The return code is zero, unless an invalid option is specified.",
+    NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) dlstat_struct = {
+    .name       = "dlstat",
+    .function   = report_call_stats,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = dlstat_usage,
+    .short_doc  = "dlstat [-e|-d] [-r] [-a array]",
+    .handle     = NULL,
+};
@@ -0,0 +1,25 @@
+#ifndef __STATS_H
+#define __STATS_H
+
+// The phases of a call that are timed separately.
+enum stats_phase {
+    STATS_DECODE,           // Parsing options and decoding parameters.
+    STATS_CALL,             // Native code.
+    STATS_BIND,             // Encoding and storing results.
+    STATS_NPHASES,
+};
+
+// Accumulates the time spent in each phase of one call, see stats.c.
+struct stats_timer {
+    uint64_t last;
+    uint64_t elapsed[STATS_NPHASES];
+};
+
+extern bool stats_enabled;
+
+uint64_t stats_clock(void);
+void stats_start(struct stats_timer *timer);
+void stats_mark(struct stats_timer *timer, enum stats_phase phase);
+void stats_commit(struct stats_timer *timer, const char *name);
+
+#endif
@@ -17,6 +17,11 @@
 #include "bashgetopt.h"
 #include "util.h"
 #include "types.h"
+#include "stats.h"
+#include "probes.h"
+#include "trace.h"
+#include "buffer.h"
+#include "layout.h"
 #include "shell.h"
 
 #define MAX_ELEMENT_SIZE 128    // Maximum length of array_name[element_name]
@@ -48,6 +53,8 @@ struct cookie {
     size_t size;
     char *unionstr;
     bool anonymous;
+    bool strings;
+    char *offsets;
 };
 
 // Map dwarf basetypes to ctypes prefixes
@@ -98,53 +105,33 @@ static char *prefix_for_basetype(const char *basetype, size_t *size)
     return NULL;
 };
 
-int insert_struct_padding(struct cu *cu, struct class_member *member, struct cookie *cookie, const char *basename)
+// Add a member called key with the specified type to the layout, and record
+// where it is in the structure.
+static int export_member(struct cookie *cookie, const char *key, const char *type, size_t offset)
 {
     char varname[MAX_ELEMENT_SIZE] = {0};
-    size_t hole = member->hole;
-    const char *padtype;
-    unsigned count = 0;
-
-    while (hole) {
-        // We need to apply some padding
-        snprintf(varname, sizeof varname, "%s[\"%s%s.__pad%u\"]",
-                                          cookie->assoc->name,
-                                          basename,
-                                          class_member__name(member, cu),
-                                          count++);
-
-        // Find the biggest type we can fit, and adjust remaining hole
-        // accordingly.
-        switch (hole % 8) {
-            case 7: padtype = "uint32"; hole -= 4; break;
-            case 6: padtype = "uint32"; hole -= 4; break;
-            case 5: padtype = "uint32"; hole -= 4; break;
-            case 4: padtype = "uint32"; hole -= 4; break;
-            case 3: padtype = "uint16"; hole -= 2; break;
-            case 2: padtype = "uint16"; hole -= 2; break;
-            case 1: padtype = "uint8";  hole -= 1; break;
-            case 0: padtype = "uint64"; hole -= 8; break;
-        }
 
-        if (assign_array_element(varname, (char *)(padtype), AV_USEIND) == NULL) {
-            builtin_error("error exporting %s", varname);
-            return -1;
-        }
+    // Generate the array element name we'll be using.
+    snprintf(varname, sizeof varname, "%s[\"%s\"]", cookie->assoc->name, key);
+
+    // Assign it the correct type.
+    if (assign_array_element(varname, (char *) type, AV_USEIND) == NULL) {
+        builtin_error("error exporting %s", varname);
+        return -1;
     }
 
+    layout_offsets_add(&cookie->offsets, key, offset);
     return 0;
 }
 
 // This worker routine recursively decodes structures. This is necessary
-// because a structure can itself contain a structure.
-int parse_class_worker(struct cu *cu, struct class *class, struct cookie *cookie, char *basename)
+// because a structure can itself contain a structure. The offset of each
+// member is recorded, so compiler padding doesn't need to be modelled.
+int parse_class_worker(struct cu *cu, struct class *class, struct cookie *cookie, char *basename, size_t base)
 {
     struct class_member *member;
     struct class_member *unionmember;
-    char varname[MAX_ELEMENT_SIZE] = {0};
-
-    // First we need to find "holes", compiler padding between members.
-    class__find_holes(class);
+    char key[MAX_ELEMENT_SIZE] = {0};
 
     // This macro iterates over every member in the class. Each member's type
     // needs to be resolved, which can get complicated if it's another struct
@@ -152,6 +139,7 @@ int parse_class_worker(struct cu *cu, struct class *class, struct cookie *cookie
     type__for_each_data_member(&class->type, member) {
         struct tag *type = cu__type(cu, member->tag.type);
         const char *membername = class_member__name(member, cu);
+        size_t offset = base + member->byte_offset;
 
         // If this member is anonymous it may not have a name.
         membername = membername ? membername : "";
@@ -173,27 +161,15 @@ int parse_class_worker(struct cu *cu, struct class *class, struct cookie *cookie
                                  ? prefix_for_basetype(cu__string(cu, tag__base_type(type)->name), NULL)
                                  : "pointer";
 
+            snprintf(key, sizeof key, "%s%s", basename, membername);
 
-            // Generate the array element name we'll be using.
-            snprintf(varname, sizeof varname, "%s[\"%s%s\"]",
-                                              cookie->assoc->name,
-                                              basename,
-                                              membername);
-
-            // Assign it the correct type.
-            if (assign_array_element(varname, (char *) typename, AV_USEIND) == NULL) {
-                builtin_error("error exporting %s", varname);
-                goto error;
-            }
-
-            // Compensate for any structure padding.
-            if (insert_struct_padding(cu, member, cookie, basename) != 0) {
-                builtin_error("error appending struct padding to %s", varname);
+            if (export_member(cookie, key, typename, offset) != 0)
                 goto error;
-            }
         } else if (type->tag == DW_TAG_array_type) {
             struct array_type *at   = tag__array_type(type);
             struct tag *abtype      = cu__type(cu, type->type);
+            const char *typename;
+            size_t size;
 
             // First we need to know the base type of the array.
             if (tag__is_typedef(abtype)) {
@@ -213,31 +189,38 @@ int parse_class_worker(struct cu *cu, struct class *class, struct cookie *cookie
                 goto error;
             }
 
+            // Convert this type from a dwarf type into a ffi type.
+            size     = sizeof(void *);
+            typename = abtype->tag == DW_TAG_base_type
+                     ? prefix_for_basetype(cu__string(cu, tag__base_type(abtype)->name), &size)
+                     : "pointer";
+
+            // With -s, char arrays are a single string, and unsigned char
+            // arrays a single hex string, rather than an element per char.
+            if (cookie->strings && typename
+             && (strcmp(typename, "char") == 0 || strcmp(typename, "uchar") == 0)) {
+                char sizedtype[32];
+
+                snprintf(sizedtype, sizeof sizedtype, "%s:%u",
+                                                      strcmp(typename, "char") == 0 ? "chars" : "hex",
+                                                      at->nr_entries[0]);
+
+                snprintf(key, sizeof key, "%s%s", basename, membername);
+
+                if (export_member(cookie, key, sizedtype, offset) != 0)
+                    goto error;
+
+                continue;
+            }
+
             // For each element, create an associative array member for it.
             for (int i = 0; i < at->nr_entries[0]; i++) {
-                // Convert this type from a dwarf type into a ffi type.
-                const char *typename = abtype->tag == DW_TAG_base_type
-                                     ? prefix_for_basetype(cu__string(cu, tag__base_type(abtype)->name), NULL)
-                                     : "pointer";
-
                 // Generate the index for this member.
-                snprintf(varname, sizeof varname, "%s[\"%s%s[%u]\"]",
-                                                   cookie->assoc->name,
-                                                   basename,
-                                                   membername,
-                                                   i);
+                snprintf(key, sizeof key, "%s%s[%u]", basename, membername, i);
 
                 // Set it to it's base type.
-                if (assign_array_element(varname, (char *) typename, AV_USEIND) == NULL) {
-                    builtin_error("error setting array element member %s", varname);
+                if (export_member(cookie, key, typename, offset + i * size) != 0)
                     goto error;
-                }
-            }
-
-            // Compensate for any structure padding.
-            if (insert_struct_padding(cu, member, cookie, basename) != 0) {
-                builtin_error("error appending struct padding to %s", varname);
-                goto error;
             }
         } else if (type->tag == DW_TAG_structure_type) {
             char *newbase;
@@ -253,14 +236,8 @@ int parse_class_worker(struct cu *cu, struct class *class, struct cookie *cookie
             sprintf(newbase, "%s%s.", basename, membername);
 
             // This member is another structure, we need to handle it recursively.
-            if (parse_class_worker(cu, tag__class(type), cookie, newbase) != EXECUTION_SUCCESS)
+            if (parse_class_worker(cu, tag__class(type), cookie, newbase, offset) != EXECUTION_SUCCESS)
                 goto error;
-
-            // Compensate for any structure padding.
-            if (insert_struct_padding(cu, member, cookie, basename) != 0) {
-                builtin_error("error appending struct padding to %s", varname);
-                goto error;
-            }
         } else if (type->tag == DW_TAG_union_type) {
             char fullname[MAX_ELEMENT_SIZE] = {0};
             char selectedmember[MAX_ELEMENT_SIZE] = {0};
@@ -292,29 +269,14 @@ int parse_class_worker(struct cu *cu, struct class *class, struct cookie *cookie
                 }
 
                 // Generate the index for this member.
-                snprintf(varname, sizeof varname, "%s[\"%s.%s\"]",
-                                                   cookie->assoc->name,
-                                                   fullname,
-                                                   class_member__name(unionmember, cu));
+                snprintf(key, sizeof key, "%s.%s", fullname, class_member__name(unionmember, cu));
 
                 // Set it to it's base type.
-                if (assign_array_element(varname,
-                                         prefix_for_basetype(cu__string(cu, tag__base_type(uniontype)->name), NULL),
-                                         AV_USEIND) == NULL) {
-                    builtin_error("error setting element member %s", varname);
-                    goto error;
-                }
-
-                // If this type is smaller than the member type, presumably we need to add padding?
-                if (member->byte_size < unionmember->byte_size) {
-                    member->hole += member->byte_size - unionmember->byte_size;
-                }
-
-                // Compensate for any structure padding.
-                if (insert_struct_padding(cu, member, cookie, basename) != 0) {
-                    builtin_error("error appending padding to %s", varname);
+                if (export_member(cookie,
+                                  key,
+                                  prefix_for_basetype(cu__string(cu, tag__base_type(uniontype)->name), NULL),
+                                  offset) != 0)
                     goto error;
-                }
 
                 // Member found.
                 goto unionfound;
@@ -340,23 +302,10 @@ unionfound:
                     goto error;
             }
 
-            // Generate the array element name we'll be using.
-            snprintf(varname, sizeof varname, "%s[\"%s%s\"]",
-                                              cookie->assoc->name,
-                                              basename,
-                                              membername);
+            snprintf(key, sizeof key, "%s%s", basename, membername);
 
-            // Assign it the correct type.
-            if (assign_array_element(varname, (char *) typename, AV_USEIND) == NULL) {
-                builtin_error("error exporting %s", varname);
+            if (export_member(cookie, key, typename, offset) != 0)
                 goto error;
-            }
-
-            // Compensate for any structure padding.
-            if (insert_struct_padding(cu, member, cookie, basename) != 0) {
-                builtin_error("error appending struct padding to %s", varname);
-                goto error;
-            }
         } else {
             builtin_warning("sorry, member %s is a %s, not supported yet!",
                             membername,
@@ -417,7 +366,7 @@ static enum load_steal_kind create_array_stealer(struct cu *cu, struct conf_load
     }
 
     // Found the class, attempt to parse it into a ctypes array.
-    if (parse_class_worker(cu, tag__class(tag), cookie, "") == EXECUTION_SUCCESS)
+    if (parse_class_worker(cu, tag__class(tag), cookie, "", 0) == EXECUTION_SUCCESS)
         cookie->result = EXECUTION_SUCCESS;
 
     // Record the size.
@@ -458,9 +407,13 @@ static int shared_library_callback(struct dl_phdr_info *info, size_t size, void
     if (strlen(info->dlpi_name) == 0)
         return 0;
 
+    PROBE1(dwarf_load_start, info->dlpi_name);
+
     // Check if this object defines the structure requested.
     cus__load_file(config->cus, config->conf, info->dlpi_name);
 
+    PROBE2(dwarf_load_end, info->dlpi_name, config->result == EXECUTION_SUCCESS);
+
     // If that succeeded, we can exit dl_iterate_phdr early.
     if (config->result == EXECUTION_SUCCESS) {
         return 1;
@@ -509,13 +462,37 @@ static int select_union_string(char *unionstr, const char *unionname, char *memb
     return -1;
 }
 
+// Allocate size zeroed bytes for -m and store the address in name. Within
+// dlscope, the buffer is released with the scope.
+static bool allocate_struct_buffer(const char *name, size_t size)
+{
+    char value[128];
+    void *data;
+
+    if (scope_buffer_create(name, size, &data) != true)
+        return false;
+
+    if (!data) {
+        // NOTE: This is not a leak.
+        if (!(data = calloc(1, size))) {
+            builtin_error("failed to allocate %zu bytes for %s", size, name);
+            return false;
+        }
+
+        snprintf(value, sizeof value, "pointer:%p", data);
+        bind_variable((char *) name, value, 0);
+    }
+
+    return true;
+}
+
 static int generate_standard_struct(WORD_LIST *list)
 {
     int opt;
+    struct stats_timer timer;
     HASH_TABLE *hashtable;
     BUCKET_CONTENTS *bucket;
     char *allocvar;
-    char allocval[128];
     struct conf_load conf_load = {
         .steal                  = create_array_stealer,
         .format_path            = NULL,
@@ -530,19 +507,26 @@ static int generate_standard_struct(WORD_LIST *list)
         .conf       = &conf_load,
         .unionstr   = NULL,
         .anonymous  = false,
+        .strings    = false,
+        .offsets    = NULL,
         .size       = 0,
     };
 
+    stats_start(&timer);
+
     reset_internal_getopt();
 
     // Name of variable to store optional allocated pointer with -m.
     allocvar = NULL;
 
-    while ((opt = internal_getopt(list, "au:m:")) != -1) {
+    while ((opt = internal_getopt(list, "asu:m:")) != -1) {
         switch (opt) {
             case 'u':
                 config.unionstr = list_optarg;
                 break;
+            case 's':
+                config.strings = true;
+                break;
             case 'a':
                 config.anonymous = true;
                 break;
@@ -573,6 +557,8 @@ static int generate_standard_struct(WORD_LIST *list)
     conf_load.cookie = &config;
     hashtable        = assoc_create(1);
 
+    trace_symbol(config.typename);
+
     // Throw away the default hash table.
     assoc_dispose((void *) config.assoc->value);
 
@@ -581,8 +567,13 @@ static int generate_standard_struct(WORD_LIST *list)
 
     dwarves__init(0);
 
+    stats_mark(&timer, STATS_DECODE);
+
+    // Searching debug information is the expensive part.
     dl_iterate_phdr(shared_library_callback, &config);
 
+    stats_mark(&timer, STATS_CALL);
+
     if (config.result != EXECUTION_SUCCESS) {
         builtin_warning("%s could not be found; check `help struct` for more",
                         config.typename);
@@ -595,15 +586,23 @@ static int generate_standard_struct(WORD_LIST *list)
     // Install the new list head.
     hashtable->bucket_array[0] = bucket;
 
-    if (allocvar) {
-        // NOTE: This is not a leak.
-        snprintf(allocval, sizeof allocval, "pointer:%p", calloc(1, config.size));
-        bind_variable(allocvar, allocval, 0);
+    // Records include any trailing padding.
+    if (layout_offsets_bind(config.assoc, config.offsets, config.size) != true) {
+        builtin_error("error recording the offsets of %s", config.assoc->name);
+        config.result = EXECUTION_FAILURE;
+        goto cleanup;
     }
 
+    if (allocvar && allocate_struct_buffer(allocvar, config.size) != true)
+        config.result = EXECUTION_FAILURE;
+
 cleanup:
+    free(config.offsets);
     cus__delete(config.cus);
     dwarves__exit();
+
+    stats_mark(&timer, STATS_BIND);
+    stats_commit(&timer, "struct");
     return config.result;
 }
 
@@ -616,7 +615,6 @@ static int sizeof_standard_struct(WORD_LIST *list)
     char *arraysize;
     ffi_type *arrtype;
     char **arrvalue;
-    char allocval[128];
     unsigned long nmembers = 1;
     unsigned long arrindex = 0;
     struct conf_load conf_load = {
@@ -731,18 +729,17 @@ static int sizeof_standard_struct(WORD_LIST *list)
             printf("%lu\n", config.size);
         }
 
-        if (allocvar) {
-            // NOTE: This is not a leak.
-            snprintf(allocval, sizeof allocval, "pointer:%p", calloc(nmembers, config.size));
-            bind_variable(allocvar, allocval, 0);
-        }
+        if (allocvar && allocate_struct_buffer(allocvar, nmembers * config.size) != true)
+            config.result = EXECUTION_FAILURE;
+        else
+            config.result = EXECUTION_SUCCESS;
 
         if (arrayindex) {
             printf("pointer:%p\n", *arrvalue + arrindex * config.size);
             free(arrvalue);
         }
 
-        return EXECUTION_SUCCESS;
+        return config.result;
     }
 
     dwarves__init(0);
@@ -758,11 +755,8 @@ static int sizeof_standard_struct(WORD_LIST *list)
             printf("%lu\n", config.size);
         }
 
-        if (allocvar) {
-            // NOTE: This is not a leak.
-            snprintf(allocval, sizeof allocval, "pointer:%p", calloc(nmembers, config.size));
-            bind_variable(allocvar, allocval, 0);
-        }
+        if (allocvar && allocate_struct_buffer(allocvar, nmembers * config.size) != true)
+            config.result = EXECUTION_FAILURE;
 
         if (arrayindex) {
             printf("pointer:%p\n", *arrvalue + arrindex * config.size);
@@ -812,6 +806,27 @@ static char *struct_usage[] = {
     "",
     "Note that anonymous unions are supported, just omit the unionname.",
     "",
+    "Offsets",
+    "",
+    "The size of the structure and the offset of each member are recorded",
+    "for the variable, so pack and unpack find members directly, skipping any",
+    "compiler padding, and pack only writes members in the layout. A member",
+    "added to the layout has no offset, so pack and unpack will fail. A copy",
+    "of the layout has no offsets at all, and is packed without padding like",
+    "any other array, so use struct again instead.",
+    "",
+    "Strings",
+    "",
+    "By default, an array member like char name[108] becomes 108 elements,",
+    "name[0] to name[107]. With -s, char arrays become one element with the",
+    "type chars:108, unpacked as a string like chars:108:/tmp/socket, and",
+    "unsigned char arrays become one element with the type hex:N, unpacked",
+    "as a hex string like hex:4:7f000001. These are packed and unpacked with a",
+    "single copy.",
+    "",
+    "   $ struct -s sockaddr_un address",
+    "   $ address[sun_path]=chars:108:/tmp/socket",
+    "",
     "Anonymous Structures",
     "",
     "It is common to see structure definitions like this:",
@@ -847,6 +862,7 @@ static char *struct_usage[] = {
     "Options:",
     "    -u unionstr    Specify which union members to select.",
     "    -a             Structure is the typedef of an anonymous struct.",
+    "    -s             Use a single string element for char arrays.",
     "    -m varname     Allocate a buffer for this structure.",
     NULL,
 };
@@ -871,7 +887,13 @@ static char *sizeof_usage[] = {
     "   sizeof -m fooptr foo",
     "",
     "Note that you will need to free the buffer when you're finished, using",
-    "dlcall free $fooptr.",
+    "dlcall free $fooptr. Alternatively, a named buffer that can be resized",
+    "and freed with its arena can be created using buf, see `help buf`:",
+    "",
+    "   buf foobuf $(sizeof foo)",
+    "",
+    "Inside dlscope, the buffer is released automatically with the scope",
+    "instead, and must not be freed, see `help dlscope`.",
     "",
     "It is also possible to allocate an array of structures in one command"
     "using this:",
@@ -896,7 +918,7 @@ struct builtin __attribute__((visibility("default"))) struct_struct = {
     .function   = generate_standard_struct,
     .flags      = BUILTIN_ENABLED,
     .long_doc   = struct_usage,
-    .short_doc  = "struct [-a] [-u unionstr] [-m ptrname] STRUCTNAME VARNAME",
+    .short_doc  = "struct [-as] [-u unionstr] [-m ptrname] STRUCTNAME VARNAME",
     .handle     = NULL,
 };
 
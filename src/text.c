@@ -0,0 +1,209 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ffi.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "common.h"
+#include "bashgetopt.h"
+#include "util.h"
+#include "types.h"
+#include "shell.h"
+
+// Decode a pointer parameter, e.g. pointer:0x1234 or $buf.
+static bool decode_string_address(const char *parameter, char **address)
+{
+    ffi_type *type;
+    void **value;
+
+    if (decode_primitive_type(parameter, (void **) &value, &type) != true) {
+        builtin_error("the pointer %s could not be parsed", parameter);
+        return false;
+    }
+
+    if (type != &ffi_type_pointer) {
+        builtin_error("expected a pointer, not %s", parameter);
+        free(value);
+        return false;
+    }
+
+    *address = *value;
+    free(value);
+
+    if (*address == NULL) {
+        builtin_error("the parameter %s is a NULL pointer", parameter);
+        return false;
+    }
+
+    return true;
+}
+
+// Store the count of bytes written in name.
+static void bind_length(const char *name, size_t length)
+{
+    char value[64];
+
+    snprintf(value, sizeof value, "%zu", length);
+    bind_variable(name, value, 0);
+}
+
+// Usage:
+//
+//  dlstr [-n name] pointer [length]
+//  dlstr -w [-N] [-l size] [-n name] pointer string
+//
+static int convert_native_string(WORD_LIST *list)
+{
+    unsigned long length;
+    unsigned long size;
+    char *resultname;
+    char *address;
+    char *string;
+    bool terminate;
+    bool bounded;
+    bool write;
+    int opt;
+
+    resultname  = NULL;
+    write       = false;
+    terminate   = true;
+    bounded     = false;
+    size        = 0;
+
+    reset_internal_getopt();
+
+    while ((opt = internal_getopt(list, "wNl:n:")) != -1) {
+        switch (opt) {
+            case 'w':
+                write = true;
+                break;
+            case 'N':
+                terminate = false;
+                break;
+            case 'l':
+                if (check_parse_ulong(list_optarg, &size) != true) {
+                    builtin_error("failed to parse `%s`, expected a number", list_optarg);
+                    return EX_USAGE;
+                }
+                bounded = true;
+                break;
+            case 'n':
+                resultname = list_optarg;
+                break;
+            default:
+                builtin_usage();
+                return EX_USAGE;
+        }
+    }
+
+    // Skip past any options.
+    if ((list = loptend) == NULL || (list->next && list->next->next)) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    if (decode_string_address(list->word->word, &address) != true)
+        return EXECUTION_FAILURE;
+
+    if (write) {
+        if (!list->next) {
+            builtin_usage();
+            return EX_USAGE;
+        }
+
+        string = list->next->word->word;
+        length = strlen(string);
+
+        // The terminator must fit in size, like strlcpy.
+        if (bounded && length + terminate > size)
+            length = size > 0 && terminate ? size - 1 : size;
+
+        memcpy(address, string, length);
+
+        if (terminate && (!bounded || size > 0))
+            address[length] = '\0';
+
+        if (resultname)
+            bind_length(resultname, length);
+
+        return EXECUTION_SUCCESS;
+    }
+
+    if (bounded || !terminate) {
+        builtin_error("-l and -N are only used with -w");
+        return EX_USAGE;
+    }
+
+    if (!resultname)
+        resultname = "DLRETVAL";
+
+    // Without a length the string must be terminated, otherwise it ends at
+    // length or the first NUL, whichever comes first. Bash strings cannot
+    // contain NUL.
+    if (list->next) {
+        if (check_parse_ulong(list->next->word->word, &length) != true) {
+            builtin_error("failed to parse `%s`, expected a number", list->next->word->word);
+            return EX_USAGE;
+        }
+
+        // If it's already terminated, bash can copy it directly.
+        if (!memchr(address, '\0', length)) {
+            string = strndup(address, length);
+            bind_variable(resultname, string, 0);
+            free(string);
+            return EXECUTION_SUCCESS;
+        }
+    }
+
+    bind_variable(resultname, address, 0);
+    return EXECUTION_SUCCESS;
+}
+
+static char *dlstr_usage[] = {
+    "Copy strings between native memory and variables.",
+    "",
+    "Read the string at pointer into the variable DLRETVAL, or name if -n is",
+    "specified. The string must be NUL terminated, unless length is given, in",
+    "which case at most length bytes are read. This is much faster than",
+    "unpacking an array of char.",
+    "",
+    "With -w, write string to the memory at pointer, followed by a NUL",
+    "terminator. With -l, at most size bytes are written, including the",
+    "terminator, which is always present when size is not zero, like",
+    "strlcpy.",
+    "",
+    "Usage:",
+    "",
+    "    $ buf text 64",
+    "    $ dlstr -w $text \"hello world\"",
+    "    $ dlcall strfry $text",
+    "    $ dlstr -n result $text",
+    "    $ echo $result",
+    "    lodr lwoleh",
+    "",
+    "    $ dlstr -n prefix $text 5",
+    "",
+    "Options:",
+    "    -n name     Use name instead of DLRETVAL, with -w store the number",
+    "                of bytes written, excluding the terminator.",
+    "    -w          Write string to pointer.",
+    "    -l size     With -w, write at most size bytes.",
+    "    -N          With -w, don't write a NUL terminator.",
+    "",
+    "Exit Status:",
+    "The return code is zero, unless pointer could not be parsed or is NULL.",
+    NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) dlstr_struct = {
+    .name       = "dlstr",
+    .function   = convert_native_string,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = dlstr_usage,
+    .short_doc  = "dlstr [-n name] pointer [length] or dlstr -w [-N] [-l size] [-n name] pointer string",
+    .handle     = NULL,
+};
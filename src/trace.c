@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "common.h"
+#include "stats.h"
+#include "trace.h"
+#include "shell.h"
+
+// When CTYPES_TRACE is set in the environment as the library is loaded, every
+// builtin invocation is appended to a ring buffer in the file it names. The
+// log is decoded into a timeline or a Chrome trace by ctypes-trace.
+//
+// This is arranged by replacing the function of each builtin with a wrapper
+// before bash reads the builtin structures, so there is no cost at all when
+// tracing is disabled. Builtins created by dlbind, and callbacks, record
+// themselves.
+bool trace_enabled;
+
+static struct trace_header *header;
+static struct trace_record *records;
+
+// The current nesting level, and the symbol of the innermost builtin.
+static uint32_t depth;
+static const char *symbol;
+
+// The struct and sizeof builtins are only present with struct support.
+#define TRACED_BUILTINS(X)                                  \
+    X(buf) X(callback) X(dlbind) X(dlcall) X(dlchain) X(dlclose)   \
+    X(dlmmap) X(dlmunmap) X(dlopen) X(dlpump) X(dlscope)    \
+    X(dlstat) X(dlstr) X(dlsym) X(dlview) X(dlwait)         \
+    X(pack) X(unpack) X(struct) X(sizeof)
+
+struct traced_builtin {
+    const char *name;
+    sh_builtin_func_t *function;
+};
+
+static int trace_builtin(struct traced_builtin *traced, WORD_LIST *list)
+{
+    const char *saved;
+    WORD_LIST *word;
+    uint32_t nargs;
+    uint64_t start;
+    int result;
+
+    for (nargs = 0, word = list; word; word = word->next)
+        nargs++;
+
+    // Builtins can be nested by callbacks.
+    saved   = symbol;
+    symbol  = NULL;
+    start   = trace_begin();
+    result  = traced->function(list);
+
+    trace_end(traced->name, symbol, nargs, start, result);
+
+    symbol  = saved;
+    return result;
+}
+
+#define DEFINE_TRACE_WRAPPER(cmd)                                           \
+    extern struct builtin cmd ## _struct __attribute__((weak));             \
+    static struct traced_builtin traced_ ## cmd;                            \
+    static int trace_ ## cmd ## _builtin(WORD_LIST *list)                   \
+    {                                                                       \
+        return trace_builtin(&traced_ ## cmd, list);                        \
+    }
+
+TRACED_BUILTINS(DEFINE_TRACE_WRAPPER)
+
+#define INSTALL_TRACE_WRAPPER(cmd)                                          \
+    if (&cmd ## _struct != NULL) {                                          \
+        traced_ ## cmd.name         = cmd ## _struct.name;                  \
+        traced_ ## cmd.function     = cmd ## _struct.function;              \
+        cmd ## _struct.function     = trace_ ## cmd ## _builtin;            \
+    }
+
+// Create the log file, which is then permanently mapped.
+static bool map_trace_log(const char *filename, uint64_t capacity)
+{
+    size_t size;
+    int fd;
+
+    size = sizeof *header + capacity * sizeof *records;
+
+    if ((fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        fprintf(stderr, "ctypes: failed to open trace log %s, %m\n", filename);
+        return false;
+    }
+
+    if (ftruncate(fd, size) != 0) {
+        fprintf(stderr, "ctypes: failed to allocate trace log %s, %m\n", filename);
+        close(fd);
+        return false;
+    }
+
+    header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (header == MAP_FAILED) {
+        fprintf(stderr, "ctypes: failed to map trace log %s, %m\n", filename);
+        header = NULL;
+        return false;
+    }
+
+    records = (struct trace_record *)(header + 1);
+
+    memcpy(header->magic, TRACE_MAGIC, sizeof header->magic);
+
+    header->version     = TRACE_VERSION;
+    header->record_size = sizeof *records;
+    header->capacity    = capacity;
+    header->count       = 0;
+    return true;
+}
+
+static void __attribute__((constructor)) init(void)
+{
+    const char *filename;
+    const char *capacity;
+    uint64_t count;
+
+    if (!(filename = getenv("CTYPES_TRACE")) || *filename == '\0')
+        return;
+
+    count = TRACE_RECORDS;
+
+    if ((capacity = getenv("CTYPES_TRACE_RECORDS"))) {
+        if ((count = strtoull(capacity, NULL, 0)) == 0) {
+            fprintf(stderr, "ctypes: CTYPES_TRACE_RECORDS must be a positive number\n");
+            return;
+        }
+    }
+
+    if (map_trace_log(filename, count) != true)
+        return;
+
+    TRACED_BUILTINS(INSTALL_TRACE_WRAPPER)
+
+    trace_enabled = true;
+}
+
+// Returns the start time of an invocation, which must be passed to trace_end().
+uint64_t trace_begin(void)
+{
+    if (!trace_enabled)
+        return 0;
+
+    depth++;
+    return stats_clock();
+}
+
+// Record the symbol the current builtin is working on, e.g. the function
+// dlcall is calling. The string must remain valid until the builtin returns.
+void trace_symbol(const char *name)
+{
+    symbol = name;
+}
+
+// Copy a string into a fixed size field of a record, padded with zeroes. The
+// field is not terminated if the string fills it.
+static void copy_field(char *field, size_t size, const char *string)
+{
+    size_t length = strnlen(string, size);
+
+    memcpy(field, string, length);
+    memset(field + length, 0, size - length);
+}
+
+void trace_end(const char *builtin,
+               const char *name,
+               uint32_t nargs,
+               uint64_t start,
+               int result)
+{
+    struct trace_record *record;
+    uint64_t index;
+
+    if (!trace_enabled || start == 0)
+        return;
+
+    depth--;
+
+    // Subshells share the mapping, so the index must be allocated atomically.
+    index   = __atomic_fetch_add(&header->count, 1, __ATOMIC_RELAXED);
+    record  = &records[index % header->capacity];
+
+    record->timestamp   = start;
+    record->duration    = stats_clock() - start;
+    record->pid         = getpid();
+    record->result      = result;
+    record->nargs       = nargs;
+    record->depth       = depth;
+
+    copy_field(record->builtin, sizeof record->builtin, builtin);
+    copy_field(record->symbol, sizeof record->symbol, name ? name : "");
+}
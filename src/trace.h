@@ -0,0 +1,44 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+// The trace log is a file containing a header followed by a ring buffer of
+// fixed size records, one for each completed builtin invocation. It is mapped
+// into memory, so it survives the shell crashing and costs no system calls to
+// write. See trace.c, and ctypes-trace.c for a decoder.
+#define TRACE_MAGIC     "CTTRACE"
+#define TRACE_VERSION   1
+
+// The default number of records kept, override with CTYPES_TRACE_RECORDS.
+#define TRACE_RECORDS   65536
+
+struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;          // Number of records in the ring.
+    uint64_t count;             // Number of records ever written.
+};
+
+struct trace_record {
+    uint64_t timestamp;         // CLOCK_MONOTONIC nanoseconds at entry.
+    uint64_t duration;          // Nanoseconds until the builtin returned.
+    int32_t pid;                // Subshells share the log.
+    int32_t result;             // Exit status.
+    uint32_t nargs;             // Number of words passed.
+    uint32_t depth;             // Nesting, e.g. dlcall inside a callback.
+    char builtin[24];           // Not terminated if the name fills it.
+    char symbol[40];            // Symbol, library or function, if any, also
+                                // not terminated if it fills it.
+};
+
+extern bool trace_enabled;
+
+uint64_t trace_begin(void);
+void trace_symbol(const char *symbol);
+void trace_end(const char *builtin,
+               const char *symbol,
+               uint32_t nargs,
+               uint64_t start,
+               int result);
+
+#endif
@@ -11,6 +11,9 @@
 #include <stdbool.h>
 #include <ffi.h>
 #include <inttypes.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 #include "builtins.h"
 #include "variables.h"
@@ -20,20 +23,6 @@
 #include "types.h"
 #include "util.h"
 
-#ifndef __GLIBC__
-#include <sys/param.h>
-#define strndupa(s, n) ({                               \
-    const char *__s = (s);                              \
-    size_t __n = (n);                                   \
-    char *__r;                                          \
-    __n = MIN(__n, strlen(__s));                        \
-    __r = alloca(__n + 1);                              \
-    memcpy(__r, __s, __n);                              \
-    __r[__n] = '\0';                                    \
-    __r;                                                \
-})
-#endif
-
 
 // Given an appropriate format and an ffi_type, create a prefixed type from
 // value and store in *result, which should be freed by the caller.
@@ -181,3 +170,317 @@ bool decode_type_prefix(const char *prefix, const char *value, ffi_type **type,
     builtin_warning("unrecognised type prefix %s", prefix);
     return false;
 }
+
+// Decode a string of at most size bytes, the remainder is zeroed.
+static bool decode_chars(const char *value, uint8_t *dest, size_t size)
+{
+    size_t length = strlen(value);
+
+    if (length > size) {
+        builtin_warning("the string %s does not fit in %zu chars", value, size);
+        return false;
+    }
+
+    memcpy(dest, value, length);
+    memset(dest + length, 0, size - length);
+    return true;
+}
+
+static char * encode_chars(const uint8_t *source, size_t size)
+{
+    return strndup((const char *) source, size);
+}
+
+// Hex digits are converted 16 bytes at a time with SSE2, which every x86_64
+// processor has, and a table for the remainder.
+static const int8_t hex_values[256] = {
+    [0 ... 255] = -1,
+    ['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+    ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+    ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+    ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+};
+
+#ifdef __SSE2__
+// Convert 16 hex digits to their values, or return false if any are invalid.
+static inline bool hex_digits_sse2(const char *value, __m128i *result)
+{
+    __m128i c       = _mm_loadu_si128((const __m128i *) value);
+    __m128i l       = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i digit   = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                    _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    __m128i alpha   = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+                                    _mm_cmplt_epi8(l, _mm_set1_epi8('f' + 1)));
+
+    if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff)
+        return false;
+
+    *result = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                           _mm_and_si128(alpha, _mm_sub_epi8(l, _mm_set1_epi8('a' - 10))));
+
+    // Combine each pair of digits into one byte in each 16 bit lane.
+    *result = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(*result, _mm_set1_epi16(0x00ff)), 4),
+                           _mm_srli_epi16(*result, 8));
+    return true;
+}
+
+// Convert the nibbles of 16 bytes to hex digits.
+static inline __m128i hex_nibbles_sse2(__m128i n)
+{
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)),
+                                   _mm_set1_epi8('a' - '0' - 10));
+
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), letter);
+}
+#endif
+
+// Decode pairs of hex digits into at most size bytes, the remainder is zeroed.
+static bool decode_hex(const char *value, uint8_t *dest, size_t size)
+{
+    size_t length = strlen(value);
+    size_t i = 0;
+
+    if (length % 2 || length / 2 > size) {
+        builtin_warning("the hex string %s does not fit in %zu bytes", value, size);
+        return false;
+    }
+
+#ifdef __SSE2__
+    for (__m128i a, b; i + 16 <= length / 2; i += 16) {
+        if (!hex_digits_sse2(value + i * 2, &a) || !hex_digits_sse2(value + i * 2 + 16, &b))
+            goto invalid;
+
+        _mm_storeu_si128((__m128i *)(dest + i), _mm_packus_epi16(a, b));
+    }
+#endif
+
+    for (; i < length / 2; i++) {
+        int hi = hex_values[(uint8_t) value[i * 2]];
+        int lo = hex_values[(uint8_t) value[i * 2 + 1]];
+
+        if (hi < 0 || lo < 0)
+            goto invalid;
+
+        dest[i] = hi << 4 | lo;
+    }
+
+    memset(dest + length / 2, 0, size - length / 2);
+    return true;
+
+invalid:
+    builtin_warning("failed to parse %s as hex", value);
+    return false;
+}
+
+static char * encode_hex(const uint8_t *source, size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    char *result = malloc(size * 2 + 1);
+    size_t i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= size; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(source + i));
+        __m128i hi = hex_nibbles_sse2(_mm_and_si128(_mm_srli_epi16(in, 4), _mm_set1_epi8(15)));
+        __m128i lo = hex_nibbles_sse2(_mm_and_si128(in, _mm_set1_epi8(15)));
+
+        _mm_storeu_si128((__m128i *)(result + i * 2), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(result + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif
+
+    for (; i < size; i++) {
+        result[i * 2]     = digits[source[i] >> 4];
+        result[i * 2 + 1] = digits[source[i] & 15];
+    }
+
+    result[size * 2] = '\0';
+    return result;
+}
+
+// Base64 is left scalar. SSE2 has no byte shuffle to map 6-bit groups to
+// digits, and the lookup tables already convert a byte per iteration.
+static const char base64_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const int8_t base64_values[256] = {
+    [0 ... 255] = -1,
+    ['A'] =  0, ['B'] =  1, ['C'] =  2, ['D'] =  3, ['E'] =  4, ['F'] =  5,
+    ['G'] =  6, ['H'] =  7, ['I'] =  8, ['J'] =  9, ['K'] = 10, ['L'] = 11,
+    ['M'] = 12, ['N'] = 13, ['O'] = 14, ['P'] = 15, ['Q'] = 16, ['R'] = 17,
+    ['S'] = 18, ['T'] = 19, ['U'] = 20, ['V'] = 21, ['W'] = 22, ['X'] = 23,
+    ['Y'] = 24, ['Z'] = 25, ['a'] = 26, ['b'] = 27, ['c'] = 28, ['d'] = 29,
+    ['e'] = 30, ['f'] = 31, ['g'] = 32, ['h'] = 33, ['i'] = 34, ['j'] = 35,
+    ['k'] = 36, ['l'] = 37, ['m'] = 38, ['n'] = 39, ['o'] = 40, ['p'] = 41,
+    ['q'] = 42, ['r'] = 43, ['s'] = 44, ['t'] = 45, ['u'] = 46, ['v'] = 47,
+    ['w'] = 48, ['x'] = 49, ['y'] = 50, ['z'] = 51, ['0'] = 52, ['1'] = 53,
+    ['2'] = 54, ['3'] = 55, ['4'] = 56, ['5'] = 57, ['6'] = 58, ['7'] = 59,
+    ['8'] = 60, ['9'] = 61, ['+'] = 62, ['/'] = 63,
+};
+
+// Decode base64 into at most size bytes, the remainder is zeroed. Padding is
+// optional.
+static bool decode_base64(const char *value, uint8_t *dest, size_t size)
+{
+    size_t length = strlen(value);
+    size_t count = 0;
+    uint32_t bits = 0;
+
+    // Ignore any padding.
+    while (length && value[length - 1] == '=')
+        length--;
+
+    if (length % 4 == 1 || length * 3 / 4 > size) {
+        builtin_warning("the base64 string %s does not fit in %zu bytes", value, size);
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        int n = base64_values[(uint8_t) value[i]];
+
+        if (n < 0) {
+            builtin_warning("failed to parse %s as base64", value);
+            return false;
+        }
+
+        bits = bits << 6 | n;
+
+        // Every four digits are three bytes.
+        if (i % 4 == 3) {
+            dest[count++] = bits >> 16;
+            dest[count++] = bits >> 8;
+            dest[count++] = bits;
+        }
+    }
+
+    switch (length % 4) {
+        case 3:
+            dest[count++] = bits >> 10;
+            dest[count++] = bits >> 2;
+            break;
+        case 2:
+            dest[count++] = bits >> 4;
+            break;
+    }
+
+    memset(dest + count, 0, size - count);
+    return true;
+}
+
+static char * encode_base64(const uint8_t *source, size_t size)
+{
+    char *result = malloc((size + 2) / 3 * 4 + 1);
+    char *p = result;
+    size_t i;
+
+    for (i = 0; i + 3 <= size; i += 3) {
+        uint32_t bits = source[i] << 16 | source[i + 1] << 8 | source[i + 2];
+
+        *p++ = base64_digits[bits >> 18];
+        *p++ = base64_digits[bits >> 12 & 63];
+        *p++ = base64_digits[bits >> 6 & 63];
+        *p++ = base64_digits[bits & 63];
+    }
+
+    if (i < size) {
+        uint32_t bits = source[i] << 16 | (i + 1 < size ? source[i + 1] << 8 : 0);
+
+        *p++ = base64_digits[bits >> 18];
+        *p++ = base64_digits[bits >> 12 & 63];
+        *p++ = i + 1 < size ? base64_digits[bits >> 6 & 63] : '=';
+        *p++ = '=';
+    }
+
+    *p = '\0';
+    return result;
+}
+
+// Sized types are a fixed number of bytes handled as one value, rather than
+// one array element per byte, e.g. chars:16:hello, hex:4:deadbeef or
+// base64:3:AQID. The value may be omitted, e.g. in a structure definition,
+// chars:108.
+static struct {
+    char *prefix;
+    bool (*decode)(const char *value, uint8_t *dest, size_t size);
+    char * (*encode)(const uint8_t *source, size_t size);
+} sized_types[] = {
+    { "chars", decode_chars, encode_chars },
+    { "hex", decode_hex, encode_hex },
+    { "base64", decode_base64, encode_base64 },
+    { 0 },
+};
+
+// Find the sized type of element, and parse the size and optional value.
+static int parse_sized_type(const char *element, size_t *size, const char **value)
+{
+    const char *colon;
+    char *end;
+
+    if (!(colon = strchr(element, ':')))
+        return -1;
+
+    for (int i = 0; sized_types[i].prefix; i++) {
+        if (strlen(sized_types[i].prefix) != colon - element
+         || strncmp(sized_types[i].prefix, element, colon - element) != 0)
+            continue;
+
+        *size = strtoul(colon + 1, &end, 10);
+
+        if (end == colon + 1 || (*end != ':' && *end != '\0') || *size == 0) {
+            builtin_warning("%s has an invalid size", element);
+            return -1;
+        }
+
+        *value = *end ? end + 1 : end;
+        return i;
+    }
+
+    return -1;
+}
+
+// Check if element has a sized type, e.g. chars:16.
+bool sized_type_prefix(const char *element)
+{
+    const char *colon = strchr(element, ':');
+
+    if (!colon)
+        return false;
+
+    for (int i = 0; sized_types[i].prefix; i++) {
+        if (strlen(sized_types[i].prefix) == colon - element
+         && strncmp(sized_types[i].prefix, element, colon - element) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+// Store the value of the sized type element at dest, if dest is not NULL, and
+// the number of bytes it occupies in *size.
+bool decode_sized_type(const char *element, size_t *size, void *dest)
+{
+    const char *value;
+    int i;
+
+    if ((i = parse_sized_type(element, size, &value)) < 0)
+        return false;
+
+    return dest ? sized_types[i].decode(value, dest, *size) : true;
+}
+
+// Create a new element from the sized type of element and the data at source,
+// which should be freed by the caller.
+char * encode_sized_type(const char *element, const void *source, size_t *size)
+{
+    const char *value;
+    char *encoded;
+    char *result;
+    int i;
+
+    if ((i = parse_sized_type(element, size, &value)) < 0)
+        return NULL;
+
+    encoded = sized_types[i].encode(source, *size);
+    asprintf(&result, "%s:%zu:%s", sized_types[i].prefix, *size, encoded);
+    free(encoded);
+    return result;
+}
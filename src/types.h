@@ -4,5 +4,8 @@
 bool decode_primitive_type(const char *parameter, void **value, ffi_type **type);
 bool decode_type_prefix(const char *prefix, const char *value, ffi_type **type, void **result, char **pformat);
 char * encode_primitive_type(const char *format, ffi_type *type, void *value);
+bool sized_type_prefix(const char *element);
+bool decode_sized_type(const char *element, size_t *size, void *dest);
+char * encode_sized_type(const char *element, const void *source, size_t *size);
 
 #endif
@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <ffi.h>
 #include <inttypes.h>
+#include <ctype.h>
 
 #include "builtins.h"
 #include "variables.h"
@@ -20,6 +21,11 @@
 #include "make_cmd.h"
 #include "util.h"
 #include "types.h"
+#include "unpack.h"
+#include "layout.h"
+#include "buffer.h"
+#include "stats.h"
+#include "probes.h"
 #include "shell.h"
 
 #if !defined(__GLIBC__) && !defined(__NEWLIB__)
@@ -34,6 +40,7 @@ struct pack_context {
     ffi_type *ptrtype;
     WORD_LIST *list;
     uint8_t *source;
+    size_t count;
     int retval;
 };
 
@@ -65,9 +72,26 @@ int pack_decode_element(ARRAY_ELEMENT *element, void *user)
 {
     struct pack_context *ctx;
     void **value;
+    size_t size;
 
     ctx = user;
 
+    // Sized types, e.g. chars:16:hello, are decoded straight into the buffer.
+    if (sized_type_prefix(element->value)) {
+        if (decode_sized_type(element->value, &size, ctx->source) == false) {
+            ctx->retval = EXECUTION_FAILURE;
+            builtin_warning("aborted pack at bad sized type %s (%s[%lu])",
+                            element->value,
+                            ctx->list->word->word,
+                            element->ind);
+            return -1;
+        }
+
+        ctx->source += size;
+        ctx->count++;
+        return 0;
+    }
+
     if (decode_primitive_type(element->value,
                               (void **)&value,
                               &ctx->ptrtype) == false) {
@@ -87,6 +111,7 @@ int pack_decode_element(ARRAY_ELEMENT *element, void *user)
 
     // Extract the data into the destination buffer.
     ctx->source = mempcpy(ctx->source, value, ctx->ptrtype->size);
+    ctx->count++;
 
     // No longer needed.
     free(value);
@@ -98,9 +123,26 @@ int pack_decode_element_assoc(BUCKET_CONTENTS *element, void *user)
 {
     struct pack_context *ctx;
     void **value;
+    size_t size;
 
     ctx = user;
 
+    // Sized types, e.g. chars:16:hello, are decoded straight into the buffer.
+    if (sized_type_prefix(element->data)) {
+        if (decode_sized_type(element->data, &size, ctx->source) == false) {
+            ctx->retval = EXECUTION_FAILURE;
+            builtin_warning("aborted pack at bad sized type %s (%s[%s])",
+                            (char *) element->data,
+                            ctx->list->word->word,
+                            element->key);
+            return -1;
+        }
+
+        ctx->source += size;
+        ctx->count++;
+        return 0;
+    }
+
     // Check if we've been passed an uninitialized type (therefore 0)
     if (strchr(element->data, ':') == NULL) {
         if (decode_type_prefix(element->data, "0", &ctx->ptrtype, (void **)&value, NULL) == true) {
@@ -129,6 +171,7 @@ int pack_decode_element_assoc(BUCKET_CONTENTS *element, void *user)
 decode:
     // Extract the data into the destination buffer.
     ctx->source = mempcpy(ctx->source, value, ctx->ptrtype->size);
+    ctx->count++;
 
     // No longer needed.
     free(value);
@@ -136,6 +179,539 @@ decode:
     return 0;
 }
 
+// The columns of a columnar pack or unpack, an indexed array for each member
+// of a layout, named prefix_member.
+struct column_context {
+    struct layout_member *members;
+    struct layout_member *next;     // The pointer to the next record, with -L.
+    SHELL_VAR **columns;
+    unsigned count;
+    uint8_t *base;
+    size_t stride;
+};
+
+// Create a variable name from prefix and the name of member, replacing any
+// characters that can't be used in a name, e.g. prefix_a_0_ for a[0].
+static char * column_name(const char *prefix, const char *member)
+{
+    char *name;
+
+    asprintf(&name, "%s_%s", prefix, member);
+
+    for (char *p = name + strlen(prefix) + 1; *p; p++) {
+        if (!isalnum((unsigned char) *p) && *p != '_')
+            *p = '_';
+    }
+
+    return name;
+}
+
+// Options for pack and unpack.
+struct pack_options {
+    unsigned long count;
+    unsigned long stride;
+    char *fields;
+    char *next;
+    bool vector;
+};
+
+// Decode the pointer to a record, or the first of several.
+static bool decode_record_pointer(const char *parameter, uint8_t **base)
+{
+    ffi_type *ptrtype;
+    void **value;
+
+    if (decode_primitive_type(parameter, (void **) &value, &ptrtype) != true) {
+        builtin_error("the parameter %s could not parsed", parameter);
+        return false;
+    }
+
+    if (ptrtype != &ffi_type_pointer) {
+        builtin_error("the parameter %s must be a pointer", parameter);
+        free(value);
+        return false;
+    }
+
+    if (*value == NULL) {
+        builtin_error("the parameter %s is a NULL pointer", parameter);
+        free(value);
+        return false;
+    }
+
+    *base = *value;
+    free(value);
+    return true;
+}
+
+// Describe the members of layout, and select those named in fields, if any.
+// If all is set, unselected members are included.
+static struct layout_member * select_members(const char *layout, const char *fields, unsigned *count, bool all)
+{
+    struct layout_member *members;
+
+    // Layouts created by struct can find members by name.
+    if (fields && !all && (members = layout_named_members(layout, fields, count)))
+        return members;
+
+    if (!(members = layout_members(layout, count)))
+        return NULL;
+
+    if (fields && select_layout_members(members, *count, fields) != true) {
+        free_layout_members(members, *count);
+        return NULL;
+    }
+
+    return members;
+}
+
+// Parse the parameters common to pack and unpack with -N, which are a pointer
+// to the first record, a layout, and a prefix for the column names.
+static bool column_context_init(struct column_context *ctx, WORD_LIST *list, struct pack_options *options)
+{
+    size_t size;
+
+    memset(ctx, 0, sizeof *ctx);
+
+    if (!list || !list->next || !list->next->next || list->next->next->next) {
+        builtin_usage();
+        return false;
+    }
+
+    if (legal_identifier(list->next->next->word->word) == 0) {
+        builtin_error("%s is not a valid variable name", list->next->next->word->word);
+        return false;
+    }
+
+    if (decode_record_pointer(list->word->word, &ctx->base) != true)
+        return false;
+
+    // The pointer to the next record is needed even if it isn't selected.
+    if (!(ctx->members = select_members(list->next->word->word,
+                                        options->fields,
+                                        &ctx->count,
+                                        options->next != NULL)))
+        return false;
+
+    for (unsigned m = 0; options->next && m < ctx->count; m++) {
+        if (strcmp(ctx->members[m].name, options->next) == 0)
+            ctx->next = &ctx->members[m];
+    }
+
+    if (options->next && (!ctx->next || ctx->next->ffitype != &ffi_type_pointer)) {
+        builtin_error("the layout %s has no pointer member named %s",
+                      list->next->word->word,
+                      options->next);
+        free_layout_members(ctx->members, ctx->count);
+        return false;
+    }
+
+    // By default, records are the size of the layout. Unless the layout was
+    // created by struct, this doesn't include any trailing padding, so use
+    // -S $(sizeof type).
+    if (layout_record_size(list->next->word->word, &size) != true) {
+        size = ctx->members[ctx->count - 1].offset + ctx->members[ctx->count - 1].size;
+    }
+
+    ctx->stride  = options->stride ? options->stride : size;
+    ctx->columns = calloc(ctx->count, sizeof(SHELL_VAR *));
+    return true;
+}
+
+static void column_context_free(struct column_context *ctx)
+{
+    free_layout_members(ctx->members, ctx->count);
+    free(ctx->columns);
+}
+
+// Find the record following record, which is NULL at the end of a list.
+static uint8_t * column_next_record(struct column_context *ctx, uint8_t *record)
+{
+    uint8_t *next;
+
+    if (!ctx->next)
+        return record + ctx->stride;
+
+    memcpy(&next, record + ctx->next->offset, sizeof next);
+    return next;
+}
+
+// Usage:
+//
+//  unpack -N count [-S stride] [-f fields] pointer layout prefix
+//  unpack -N max -L next [-f fields] pointer layout prefix
+//
+static int unpack_columns(WORD_LIST *list, struct pack_options *options)
+{
+    struct column_context ctx;
+    char *prefix;
+    char *name;
+    char *value;
+    unsigned long i = 0;
+
+    if (column_context_init(&ctx, list, options) != true)
+        return EXECUTION_FAILURE;
+
+    prefix = list->next->next->word->word;
+
+    // Replace any existing columns, padding doesn't have a column.
+    for (unsigned m = 0; m < ctx.count; m++) {
+        if (!ctx.members[m].selected)
+            continue;
+
+        name = column_name(prefix, ctx.members[m].name);
+
+        unbind_variable(name);
+
+        ctx.columns[m] = make_new_array_variable(name);
+
+        free(name);
+    }
+
+    for (uint8_t *record = ctx.base, *next; record && i < options->count; record = next, i++) {
+        next = column_next_record(&ctx, record);
+
+        for (unsigned m = 0; m < ctx.count; m++) {
+            if (!ctx.columns[m])
+                continue;
+
+            if (!(value = encode_layout_member(&ctx.members[m], record))) {
+                column_context_free(&ctx);
+                return EXECUTION_FAILURE;
+            }
+
+            array_insert(array_cell(ctx.columns[m]), i, value);
+            free(value);
+        }
+    }
+
+    PROBE2(unpack, prefix, i * ctx.count);
+
+    column_context_free(&ctx);
+    return EXECUTION_SUCCESS;
+}
+
+// Usage:
+//
+//  pack -N count [-S stride] [-f fields] pointer layout prefix
+//  pack -N max -L next [-f fields] pointer layout prefix
+//
+static int pack_columns(WORD_LIST *list, struct pack_options *options)
+{
+    struct column_context ctx;
+    SHELL_VAR *column;
+    char *prefix;
+    char *name;
+    char *value;
+    unsigned long i = 0;
+
+    if (column_context_init(&ctx, list, options) != true)
+        return EXECUTION_FAILURE;
+
+    prefix = list->next->next->word->word;
+
+    // Members without a column are left unchanged.
+    for (unsigned m = 0; m < ctx.count; m++) {
+        if (!ctx.members[m].selected)
+            continue;
+
+        name = column_name(prefix, ctx.members[m].name);
+
+        if ((column = find_variable(name)) && array_p(column) && !invisible_p(column))
+            ctx.columns[m] = column;
+
+        free(name);
+    }
+
+    for (uint8_t *record = ctx.base, *next; record && i < options->count; record = next, i++) {
+        next = column_next_record(&ctx, record);
+
+        for (unsigned m = 0; m < ctx.count; m++) {
+            if (!ctx.columns[m])
+                continue;
+
+            // As are records without a value.
+            if (!(value = array_reference(array_cell(ctx.columns[m]), i)))
+                continue;
+
+            if (decode_layout_member(&ctx.members[m], value, record) != true) {
+                builtin_warning("aborted pack at bad value %s (%s_%s[%lu])",
+                                value,
+                                prefix,
+                                ctx.members[m].name,
+                                i);
+                column_context_free(&ctx);
+                return EXECUTION_FAILURE;
+            }
+        }
+    }
+
+    PROBE2(pack, prefix, i * ctx.count);
+
+    column_context_free(&ctx);
+    return EXECUTION_SUCCESS;
+}
+
+// Decode the selected members of the layout name from the record at base, or
+// every member if fields is NULL.
+static int unpack_members(const char *name, uint8_t *base, const char *fields)
+{
+    struct layout_member *members;
+    unsigned count;
+    char *value;
+    int result;
+
+    if (!(members = select_members(name, fields, &count, false)))
+        return EXECUTION_FAILURE;
+
+    result = EXECUTION_SUCCESS;
+
+    for (unsigned m = 0; m < count; m++) {
+        if (!members[m].selected)
+            continue;
+
+        if (!(value = encode_layout_member(&members[m], base))) {
+            result = EXECUTION_FAILURE;
+            break;
+        }
+
+        free(*members[m].value);
+        *members[m].value = value;
+    }
+
+    PROBE2(unpack, name, count);
+
+    free_layout_members(members, count);
+    return result;
+}
+
+// Encode the selected members of the layout name into the record at base, or
+// every member if fields is NULL.
+static int pack_members(const char *name, uint8_t *base, const char *fields)
+{
+    struct layout_member *members;
+    unsigned count;
+    char *value;
+    int result;
+
+    if (!(members = select_members(name, fields, &count, false)))
+        return EXECUTION_FAILURE;
+
+    result = EXECUTION_SUCCESS;
+
+    for (unsigned m = 0; m < count; m++) {
+        if (!members[m].selected)
+            continue;
+
+        // Members without a value are zero, e.g. int, as with pack.
+        value = *members[m].value;
+        value = members[m].ffitype && !strchr(value, ':') ? "0" : value;
+
+        if (decode_layout_member(&members[m], value, base) != true) {
+            builtin_warning("aborted pack at bad value %s (%s[%s])",
+                            *members[m].value,
+                            name,
+                            members[m].name);
+            result = EXECUTION_FAILURE;
+            break;
+        }
+    }
+
+    PROBE2(pack, name, count);
+
+    free_layout_members(members, count);
+    return result;
+}
+
+// Usage:
+//
+//  unpack -f fields pointer layout
+//  pack -f fields pointer layout
+//
+static int convert_fields(WORD_LIST *list, struct pack_options *options, bool pack)
+{
+    uint8_t *base;
+
+    if (!list || !list->next || list->next->next) {
+        builtin_usage();
+        return EXECUTION_FAILURE;
+    }
+
+    if (decode_record_pointer(list->word->word, &base) != true)
+        return EXECUTION_FAILURE;
+
+    return pack ? pack_members(list->next->word->word, base, options->fields)
+                : unpack_members(list->next->word->word, base, options->fields);
+}
+
+struct vector_context {
+    char **vector;
+    char *strings;
+    size_t count;
+    size_t size;
+};
+
+static int vector_string_size(ARRAY_ELEMENT *element, void *user)
+{
+    struct vector_context *ctx = user;
+
+    ctx->size += strlen(element->value) + 1;
+    ctx->count++;
+    return 0;
+}
+
+static int vector_string_copy(ARRAY_ELEMENT *element, void *user)
+{
+    struct vector_context *ctx = user;
+
+    *ctx->vector++  = ctx->strings;
+    ctx->strings    = stpcpy(ctx->strings, element->value) + 1;
+    return 0;
+}
+
+// Usage:
+//
+//  pack -z name array
+//
+// Create a NULL terminated vector of strings, like argv, from array. The
+// strings follow the vector in the same allocation, so the address stored in
+// name can be released with a single free, or with the scope in dlscope.
+static int pack_string_vector(WORD_LIST *list)
+{
+    struct vector_context ctx = {0};
+    char value[128];
+    SHELL_VAR *var;
+    void *block;
+
+    if (!list || !list->next || list->next->next) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    if (!(var = find_variable(list->next->word->word)) || !array_p(var) || invisible_p(var)) {
+        builtin_error("%s is not an indexed array", list->next->word->word);
+        return EXECUTION_FAILURE;
+    }
+
+    array_walk(array_cell(var), vector_string_size, &ctx);
+
+    ctx.size += (ctx.count + 1) * sizeof(char *);
+
+    // Within dlscope, the block is released with the scope.
+    if (scope_buffer_create(list->word->word, ctx.size, &block) != true)
+        return EXECUTION_FAILURE;
+
+    if (!block) {
+        if (!(block = calloc(1, ctx.size))) {
+            builtin_error("failed to allocate %zu bytes", ctx.size);
+            return EXECUTION_FAILURE;
+        }
+
+        snprintf(value, sizeof value, "pointer:%p", block);
+        bind_variable(list->word->word, value, 0);
+    }
+
+    ctx.vector  = block;
+    ctx.strings = (char *)(ctx.vector + ctx.count + 1);
+
+    array_walk(array_cell(var), vector_string_copy, &ctx);
+
+    *ctx.vector = NULL;
+
+    PROBE2(pack, list->next->word->word, ctx.count);
+    return EXECUTION_SUCCESS;
+}
+
+// Usage:
+//
+//  unpack -z pointer array
+//
+// Read a NULL terminated vector of strings, like argv or environ, into array.
+static int unpack_string_vector(WORD_LIST *list)
+{
+    SHELL_VAR *var;
+    uint8_t *base;
+    char **vector;
+    size_t count;
+
+    if (!list || !list->next || list->next->next) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    if (decode_record_pointer(list->word->word, &base) != true)
+        return EXECUTION_FAILURE;
+
+    unbind_variable(list->next->word->word);
+
+    if (!(var = make_new_array_variable(list->next->word->word))) {
+        builtin_error("failed to create array %s", list->next->word->word);
+        return EXECUTION_FAILURE;
+    }
+
+    for (vector = (char **) base, count = 0; vector[count]; count++)
+        array_insert(array_cell(var), count, vector[count]);
+
+    PROBE2(unpack, list->next->word->word, count);
+    return EXECUTION_SUCCESS;
+}
+
+// Parse the options common to pack and unpack.
+static bool parse_pack_options(WORD_LIST **list, struct pack_options *options)
+{
+    int opt;
+
+    memset(options, 0, sizeof *options);
+
+    reset_internal_getopt();
+
+    while ((opt = internal_getopt(*list, "N:S:f:L:z")) != -1) {
+        switch (opt) {
+            case 'N':
+                if (check_parse_ulong(list_optarg, &options->count) != true || options->count == 0) {
+                    builtin_error("failed to parse `%s`, expected a count", list_optarg);
+                    return false;
+                }
+                break;
+            case 'S':
+                if (check_parse_ulong(list_optarg, &options->stride) != true) {
+                    builtin_error("failed to parse `%s`, expected a number", list_optarg);
+                    return false;
+                }
+                break;
+            case 'f':
+                options->fields = list_optarg;
+                break;
+            case 'L':
+                options->next = list_optarg;
+                break;
+            case 'z':
+                options->vector = true;
+                break;
+            default:
+                builtin_usage();
+                return false;
+        }
+    }
+
+    if ((options->stride || options->next) && !options->count) {
+        builtin_error("-S and -L can only be used with -N");
+        return false;
+    }
+
+    if (options->stride && options->next) {
+        builtin_error("-S cannot be used with -L");
+        return false;
+    }
+
+    if (options->vector && (options->count || options->fields)) {
+        builtin_error("-z cannot be used with -N or -f");
+        return false;
+    }
+
+    *list = loptend;
+    return true;
+}
+
 static int pack_prefixed_array(WORD_LIST *list)
 {
     SHELL_VAR *dest_v;
@@ -143,6 +719,29 @@ static int pack_prefixed_array(WORD_LIST *list)
     HASH_TABLE *dest_h;
     void **value;
     struct pack_context ctx = { 0 };
+    struct stats_timer timer;
+    struct pack_options options;
+
+    stats_start(&timer);
+
+    if (parse_pack_options(&list, &options) != true)
+        return EX_USAGE;
+
+    if (options.vector) {
+        ctx.retval = pack_string_vector(list);
+        stats_mark(&timer, STATS_CALL);
+        stats_commit(&timer, "pack");
+        return ctx.retval;
+    }
+
+    if (options.count || options.fields) {
+        ctx.retval = options.count
+                   ? pack_columns(list, &options)
+                   : convert_fields(list, &options, true);
+        stats_mark(&timer, STATS_CALL);
+        stats_commit(&timer, "pack");
+        return ctx.retval;
+    }
 
     // Assume success by default.
     ctx.retval = EXECUTION_SUCCESS;
@@ -172,6 +771,12 @@ static int pack_prefixed_array(WORD_LIST *list)
         goto error;
     }
 
+    if (*value == NULL) {
+        builtin_error("the destination parameter is a NULL pointer");
+        free(value);
+        goto error;
+    }
+
     // Skip to next parameter.
     list        = list->next;
     ctx.source  = *value;
@@ -179,7 +784,12 @@ static int pack_prefixed_array(WORD_LIST *list)
 
     GET_ARRAY_FROM_VAR(list->word->word, dest_v, dest_a);
 
-    if (assoc_p(dest_v)) {
+    stats_mark(&timer, STATS_DECODE);
+
+    if (layout_has_offsets(list->word->word)) {
+        // Layouts created by struct know where each member is.
+        ctx.retval = pack_members(list->word->word, ctx.source, NULL);
+    } else if (assoc_p(dest_v)) {
         // Extract the hash table
         dest_h = (HASH_TABLE *) dest_v->value;
 
@@ -195,6 +805,11 @@ static int pack_prefixed_array(WORD_LIST *list)
         goto error;
     }
 
+    PROBE2(pack, list->word->word, ctx.count);
+
+    stats_mark(&timer, STATS_CALL);
+    stats_commit(&timer, "pack");
+
     return ctx.retval;
 
 error:
@@ -205,6 +820,7 @@ struct unpack_context {
     ffi_type *ptrtype;
     WORD_LIST *list;
     uint8_t *source;
+    size_t count;
     int retval;
 };
 
@@ -213,9 +829,29 @@ int unpack_decode_element(ARRAY_ELEMENT *element, void *user)
 {
     struct unpack_context *ctx;
     char *format;
+    size_t size;
 
     ctx = user;
 
+    // Sized types keep their size, e.g. chars:16:hello.
+    if (sized_type_prefix(element->value)) {
+        if (!(format = encode_sized_type(element->value, ctx->source, &size))) {
+            ctx->retval = EXECUTION_FAILURE;
+            builtin_warning("aborted unpack at bad sized type %s (%s[%lu])",
+                            element->value,
+                            ctx->list->word->word,
+                            element->ind);
+            return -1;
+        }
+
+        FREE(element->value);
+
+        element->value = format;
+        ctx->source += size;
+        ctx->count++;
+        return 0;
+    }
+
     // Truncate it if there's already a value, e.g.
     // a=(int:0 int:0) is accceptable to initialize a buffer.
     if ((format = strchr(element->value, ':')))
@@ -247,6 +883,7 @@ int unpack_decode_element(ARRAY_ELEMENT *element, void *user)
 
     // Skip to next element.
     ctx->source += ctx->ptrtype->size;
+    ctx->count++;
 
     return 0;
 }
@@ -256,9 +893,29 @@ int unpack_decode_element_assoc(BUCKET_CONTENTS *element, void *user)
 {
     struct unpack_context *ctx;
     char *format;
+    size_t size;
 
     ctx = user;
 
+    // Sized types keep their size, e.g. chars:16:hello.
+    if (sized_type_prefix(element->data)) {
+        if (!(format = encode_sized_type(element->data, ctx->source, &size))) {
+            ctx->retval = EXECUTION_FAILURE;
+            builtin_warning("aborted unpack at bad sized type %s (%s[%s])",
+                            (char *) element->data,
+                            ctx->list->word->word,
+                            element->key);
+            return -1;
+        }
+
+        FREE(element->data);
+
+        element->data = format;
+        ctx->source += size;
+        ctx->count++;
+        return 0;
+    }
+
     // Truncate it if there's already a value, e.g.
     // a=(int:0 int:0) is accceptable to initialize a buffer.
     if ((format = strchr(element->data, ':')))
@@ -290,20 +947,82 @@ int unpack_decode_element_assoc(BUCKET_CONTENTS *element, void *user)
 
     // Skip to next element.
     ctx->source += ctx->ptrtype->size;
+    ctx->count++;
 
     return 0;
 }
 
-static int unpack_prefixed_array(WORD_LIST *list)
+// Decode native memory at source into the prefixed array or associative
+// array called name.
+int unpack_prefixed_memory(const char *name, void *source)
 {
     SHELL_VAR *dest_v;
     ARRAY *dest_a;
     HASH_TABLE *dest_h;
+    WORD_DESC word = { .word = (char *) name };
+    WORD_LIST list = { .word = &word };
+    struct unpack_context ctx = {
+        .retval = EXECUTION_SUCCESS,
+        .source = source,
+        .list   = &list,
+    };
+
+    // Layouts created by struct know where each member is.
+    if (layout_has_offsets(name)) {
+        return unpack_members(name, source, NULL);
+    }
+
+    GET_ARRAY_FROM_VAR(name, dest_v, dest_a);
+
+    if (dest_v && assoc_p(dest_v)) {
+        // Extract the hash table
+        dest_h = (HASH_TABLE *) dest_v->value;
+
+        if (dest_h->nbuckets != 1) {
+            builtin_warning("the associative array %s will not maintain it's order", name);
+        }
+
+        assoc_walk_data(dest_h, unpack_decode_element_assoc, &ctx);
+    } else if (dest_v && array_p(dest_v)) {
+        array_walk(dest_a, unpack_decode_element, &ctx);
+    } else {
+        builtin_error("expected an array or associative array");
+        return EXECUTION_FAILURE;
+    }
+
+    PROBE2(unpack, name, ctx.count);
+
+    return ctx.retval;
+}
+
+static int unpack_prefixed_array(WORD_LIST *list)
+{
+    struct stats_timer timer;
+    struct pack_options options;
+    ffi_type *ptrtype;
     void **value;
-    struct unpack_context ctx = { 0 };
+    int result;
 
-    // Assume success by default.
-    ctx.retval = EXECUTION_SUCCESS;
+    stats_start(&timer);
+
+    if (parse_pack_options(&list, &options) != true)
+        return EX_USAGE;
+
+    if (options.vector) {
+        result = unpack_string_vector(list);
+        stats_mark(&timer, STATS_BIND);
+        stats_commit(&timer, "unpack");
+        return result;
+    }
+
+    if (options.count || options.fields) {
+        result = options.count
+               ? unpack_columns(list, &options)
+               : convert_fields(list, &options, false);
+        stats_mark(&timer, STATS_BIND);
+        stats_commit(&timer, "unpack");
+        return result;
+    }
 
     // Verify we have two parameters.
     if (!list || !list->next) {
@@ -319,44 +1038,113 @@ static int unpack_prefixed_array(WORD_LIST *list)
     // Fetch the source pointer.
     if (decode_primitive_type(list->word->word,
                               (void **)&value,
-                              &ctx.ptrtype) != true) {
+                              &ptrtype) != true) {
         builtin_error("the source parameter %s could not parsed", list->word->word);
         goto error;
     }
 
     // Verify that it was a pointer.
-    if (ctx.ptrtype != &ffi_type_pointer) {
+    if (ptrtype != &ffi_type_pointer) {
         builtin_error("the source parameter must be a pointer");
+        free(value);
         goto error;
     }
 
-    // Skip to next parameter.
-    list        = list->next;
-    ctx.source  = *value;
-    ctx.list    = list;
+    if (*value == NULL) {
+        builtin_error("the source parameter is a NULL pointer");
+        free(value);
+        goto error;
+    }
 
-    GET_ARRAY_FROM_VAR(list->word->word, dest_v, dest_a);
+    stats_mark(&timer, STATS_DECODE);
 
-    if (assoc_p(dest_v)) {
-        // Extract the hash table
-        dest_h = (HASH_TABLE *) dest_v->value;
+    result = unpack_prefixed_memory(list->next->word->word, *value);
 
-        if (dest_h->nbuckets != 1) {
-            builtin_warning("the associative array %s will not maintain it's order", list->word->word);
+    stats_mark(&timer, STATS_BIND);
+    stats_commit(&timer, "unpack");
+
+    free(value);
+    return result;
+
+error:
+    return EXECUTION_FAILURE;
+}
+
+struct sizeof_context {
+    size_t size;
+    bool valid;
+};
+
+// Callback to add up the size of each element.
+static int sizeof_element_type(const char *element, struct sizeof_context *ctx)
+{
+    ffi_type *type;
+    char *prefix;
+    size_t size;
+
+    if (sized_type_prefix(element)) {
+        if (decode_sized_type(element, &size, NULL) != true) {
+            ctx->valid = false;
+            return -1;
         }
 
-        assoc_walk_data(dest_h, unpack_decode_element_assoc, &ctx);
-    } else if (array_p(dest_v)) {
-        array_walk(dest_a, unpack_decode_element, &ctx);
-    } else {
-        builtin_error("expected an array or associative array");
-        goto error;
+        ctx->size += size;
+        return 0;
     }
 
-    return ctx.retval;
+    // Ignore any existing value, e.g. int:1234
+    prefix = strchr(element, ':')
+           ? strndupa(element, strchr(element, ':') - element)
+           : (char *) element;
 
-error:
-    return EXECUTION_FAILURE;
+    if (decode_type_prefix(prefix, NULL, &type, NULL, NULL) != true) {
+        ctx->valid = false;
+        return -1;
+    }
+
+    ctx->size += type->size;
+    return 0;
+}
+
+static int sizeof_element(ARRAY_ELEMENT *element, void *user)
+{
+    return sizeof_element_type(element->value, user);
+}
+
+static int sizeof_element_assoc(BUCKET_CONTENTS *element, void *user)
+{
+    return sizeof_element_type(element->data, user);
+}
+
+// Calculate how many bytes pack would write from the prefixed array name,
+// or how many bytes unpack would read into it.
+bool prefixed_array_size(const char *name, size_t *size)
+{
+    SHELL_VAR *var;
+    struct sizeof_context ctx = {
+        .size   = 0,
+        .valid  = true,
+    };
+
+    if (!(var = find_variable(name)) || invisible_p(var)) {
+        return false;
+    }
+
+    // Layouts created by struct know the size of the structure.
+    if (layout_has_offsets(name)) {
+        return layout_record_size(name, size);
+    }
+
+    if (assoc_p(var)) {
+        assoc_walk_data(assoc_cell(var), sizeof_element_assoc, &ctx);
+    } else if (array_p(var)) {
+        array_walk(array_cell(var), sizeof_element, &ctx);
+    } else {
+        return false;
+    }
+
+    *size = ctx.size;
+    return ctx.valid;
 }
 
 static char *unpack_usage[] = {
@@ -371,11 +1159,75 @@ static char *unpack_usage[] = {
     "pointer:0x1234 char:a int:1234 long:-1",
     "  pack pointer:01234 struct",
     "",
+    "A run of bytes can be handled as one element with the sized types chars,",
+    "hex and base64, which include the size, e.g. chars:16:hello or hex:4.",
+    "",
+    "$ digest=(hex:20)",
+    "$ unpack $md digest",
+    "",
+    "With -N, unpack count consecutive records described by a layout into an",
+    "indexed array for each member, named prefix_member. Any characters that",
+    "cannot be used in a variable name are replaced with _, padding members",
+    "are skipped. Records are the size of the layout, unless a stride is",
+    "specified with -S, which should include any trailing padding.",
+    "",
+    "$ struct pollfd pollfd",
+    "$ unpack -N $nfds -S $(sizeof pollfd) $fds pollfd poll",
+    "$ echo ${poll_revents[0]}",
+    "",
+    "With -f, only the comma separated list of members fields are unpacked,",
+    "the rest of the layout is unchanged. A nested structure or array selects",
+    "all of its members. With -N, only arrays for these members are created.",
+    "",
+    "$ unpack -f st_size,st_mtim $statbuf stat",
+    "",
+    "With -L, the records are a linked list rather than consecutive, next is",
+    "the name of the pointer member to follow. At most count records are",
+    "unpacked, the list ends at a NULL pointer.",
+    "",
+    "$ unpack -N 100 -L ai_next $res addrinfo ai",
+    "$ echo ${#ai_addr[@]} addresses",
+    "",
+    "With -z, unpack a NULL terminated vector of strings, like argv or",
+    "environ, into an indexed array of strings without prefixes.",
+    "",
+    "Options:",
+    "    -N count    Unpack count records into an array for each member.",
+    "    -S stride   The distance between records, in bytes.",
+    "    -L next     Follow the pointer member next to each record.",
+    "    -f fields   Only unpack these members.",
+    "    -z          Unpack a NULL terminated vector of strings.",
+    "",
     NULL,
 };
 
 static char *pack_usage[] = {
     "Convert data from a prefixed bash array into native memory.",
+    "",
+    "With -N, pack count consecutive records from the arrays prefix_member",
+    "created by unpack -N. Values may be prefixed or not, members without an",
+    "array and records without a value are left unchanged.",
+    "",
+    "With -f, only the comma separated list of members fields are packed,",
+    "the rest of the memory is unchanged.",
+    "",
+    "$ pack -f events $fdsptr pollfd",
+    "",
+    "With -z, the parameters are a variable name and an indexed array of",
+    "strings. A NULL terminated vector of the strings, like argv, is",
+    "allocated, and the address stored in name. The strings are in the same",
+    "allocation, so a single free releases everything.",
+    "",
+    "$ args=(ls -l /tmp)",
+    "$ pack -z argv args",
+    "$ dlcall execvp string:ls $argv",
+    "",
+    "Options:",
+    "    -N count    Pack count records from an array for each member.",
+    "    -S stride   The distance between records, in bytes.",
+    "    -L next     Follow the pointer member next to each record.",
+    "    -f fields   Only pack these members.",
+    "    -z          Pack a NULL terminated vector of strings.",
     NULL,
 };
 
@@ -384,7 +1236,7 @@ struct builtin __attribute__((visibility("default"))) unpack_struct = {
     .function   = unpack_prefixed_array,
     .flags      = BUILTIN_ENABLED,
     .long_doc   = unpack_usage,
-    .short_doc  = "unpack pointer array",
+    .short_doc  = "unpack [-f fields] [-N count [-S stride|-L next]] [-z] pointer array [prefix]",
     .handle     = NULL,
 };
 
@@ -393,7 +1245,7 @@ struct builtin __attribute__((visibility("default"))) pack_struct = {
     .function   = pack_prefixed_array,
     .flags      = BUILTIN_ENABLED,
     .long_doc   = pack_usage,
-    .short_doc  = "pack pointer array",
+    .short_doc  = "pack [-f fields] [-N count [-S stride|-L next]] pointer array [prefix] or pack -z name array",
     .handle     = NULL,
 };
 
@@ -0,0 +1,10 @@
+#ifndef __UNPACK_H
+#define __UNPACK_H
+
+void assoc_walk_data(HASH_TABLE *table,
+                     int (*func)(BUCKET_CONTENTS *, void *),
+                     void *data);
+int unpack_prefixed_memory(const char *name, void *source);
+bool prefixed_array_size(const char *name, size_t *size);
+
+#endif
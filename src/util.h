@@ -4,4 +4,18 @@
 bool check_parse_long(const char *number, long *result);
 bool check_parse_ulong(const char *number, unsigned long *result);
 
+#ifndef __GLIBC__
+#include <sys/param.h>
+#define strndupa(s, n) ({                               \
+    const char *__s = (s);                              \
+    size_t __n = (n);                                   \
+    char *__r;                                          \
+    __n = MIN(__n, strlen(__s));                        \
+    __r = alloca(__n + 1);                              \
+    memcpy(__r, __s, __n);                              \
+    __r[__n] = '\0';                                    \
+    __r;                                                \
+})
+#endif
+
 #endif
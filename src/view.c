@@ -0,0 +1,454 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ffi.h>
+
+#include "builtins.h"
+#include "variables.h"
+#include "arrayfunc.h"
+#include "common.h"
+#include "bashgetopt.h"
+#include "util.h"
+#include "types.h"
+#include "shell.h"
+
+// An indexed array backed by native memory. Assignments are written straight
+// to native memory by the assign_func hook. Bash also has a dynamic_value hook,
+// but it's called on every reference without the subscript, so it would have
+// to check the whole array each time. Instead the array is converted when the
+// view is created, and brought up to date with dlview -u. A copy of the native
+// data from the last update is kept, so that only elements that have changed
+// since are converted again.
+struct view {
+    char *name;
+    SHELL_VAR *var;
+    uint8_t *address;
+    uint8_t *shadow;            // The native data last converted.
+    unsigned long count;
+    size_t size;                // Size of each element.
+    char *type;                 // The type prefix, e.g. int32 or hex:16.
+    ffi_type *ffitype;          // NULL for sized types.
+    char *format;
+    struct view *next;
+};
+
+static struct view *views;
+
+static struct view * find_view(SHELL_VAR *var)
+{
+    for (struct view *view = views; view; view = view->next) {
+        if (view->var == var)
+            return view;
+    }
+
+    return NULL;
+}
+
+static void destroy_view(struct view *view)
+{
+    free(view->name);
+    free(view->shadow);
+    free(view->type);
+    free(view);
+}
+
+// Create a new prefixed element from the native data at index, which should be
+// freed by the caller.
+static char * encode_view_element(struct view *view, unsigned long index)
+{
+    size_t size;
+
+    if (view->ffitype == NULL)
+        return encode_sized_type(view->type, view->address + index * view->size, &size);
+
+    return encode_primitive_type(view->format, view->ffitype, view->address + index * view->size);
+}
+
+// Decode value into the native data at index. The type prefix is optional,
+// but must match the view if present.
+static bool decode_view_element(struct view *view, unsigned long index, const char *value)
+{
+    size_t length;
+    size_t size;
+    char *element;
+    void *data;
+    bool result;
+
+    length = strlen(view->type);
+
+    if (strncmp(value, view->type, length) == 0 && value[length] == ':')
+        value += length + 1;
+
+    if (view->ffitype == NULL) {
+        asprintf(&element, "%s:%s", view->type, value);
+
+        if ((result = decode_sized_type(element, &size, NULL)) == true)
+            result = decode_sized_type(element, &size, view->address + index * view->size);
+
+        free(element);
+        return result;
+    }
+
+    if (decode_type_prefix(view->type, value, NULL, &data, NULL) != true)
+        return false;
+
+    memcpy(view->address + index * view->size, data, view->size);
+    free(data);
+    return true;
+}
+
+static int sync_view_element(ARRAY_ELEMENT *element, void *user)
+{
+    struct view *view = user;
+    uint8_t *native;
+    uint8_t *shadow;
+
+    if (element_index(element) < 0 || element_index(element) >= view->count)
+        return 0;
+
+    native = view->address + element_index(element) * view->size;
+    shadow = view->shadow + element_index(element) * view->size;
+
+    if (memcmp(native, shadow, view->size) == 0)
+        return 0;
+
+    free(element_value(element));
+
+    element_value(element) = encode_view_element(view, element_index(element));
+
+    memcpy(shadow, native, view->size);
+    return 0;
+}
+
+// Bring the array up to date with native memory, converting only elements
+// that have changed since the last update.
+static void sync_view(struct view *view)
+{
+    ARRAY *array;
+    char *value;
+
+    array = array_cell(view->var);
+
+    array_walk(array, sync_view_element, view);
+
+    // Elements are missing when the view is created, or if they were unset.
+    if (array_num_elements(array) == view->count)
+        return;
+
+    for (unsigned long i = 0; i < view->count; i++) {
+        if (array_reference(array, i))
+            continue;
+
+        if (!(value = encode_view_element(view, i)))
+            continue;
+
+        array_insert(array, i, value);
+        memcpy(view->shadow + i * view->size, view->address + i * view->size, view->size);
+        free(value);
+    }
+}
+
+// The assign_func hook, called to assign an element.
+static SHELL_VAR * assign_view(SHELL_VAR *self, char *value, arrayind_t index, char *key)
+{
+    struct view *view;
+    char *element;
+
+    if (!(view = find_view(self))) {
+        array_insert(array_cell(self), index, value);
+        return self;
+    }
+
+    if (index < 0 || index >= view->count) {
+        builtin_error("%s[%jd]: index out of range, the view has %lu elements",
+                      self->name,
+                      (intmax_t) index,
+                      view->count);
+        return self;
+    }
+
+    if (decode_view_element(view, index, value) != true) {
+        builtin_error("%s[%jd]: could not assign %s", self->name, (intmax_t) index, value);
+        return self;
+    }
+
+    // Store the value as it would be read back.
+    if ((element = encode_view_element(view, index))) {
+        array_insert(array_cell(self), index, element);
+        free(element);
+    }
+
+    memcpy(view->shadow + index * view->size, view->address + index * view->size, view->size);
+    return self;
+}
+
+// Views whose variable has been unset are no longer reachable, and can be
+// released.
+static void release_stale_views(void)
+{
+    struct view **view;
+    struct view *stale;
+    SHELL_VAR *var;
+
+    for (view = &views; *view;) {
+        var = find_variable((*view)->name);
+
+        if (var != (*view)->var || var->assign_func != assign_view) {
+            stale   = *view;
+            *view   = stale->next;
+            destroy_view(stale);
+            continue;
+        }
+
+        view = &(*view)->next;
+    }
+}
+
+// Find the view name.
+static struct view ** find_named_view(const char *name)
+{
+    struct view **view;
+
+    for (view = &views; *view; view = &(*view)->next) {
+        if (strcmp((*view)->name, name) == 0)
+            return view;
+    }
+
+    builtin_error("%s is not a view created by dlview", name);
+    return NULL;
+}
+
+// Decode a pointer parameter, e.g. pointer:0x1234 or $buf.
+static bool decode_view_address(const char *parameter, uint8_t **address)
+{
+    ffi_type *type;
+    void **value;
+
+    if (decode_primitive_type(parameter, (void **) &value, &type) != true
+     || type != &ffi_type_pointer) {
+        builtin_error("could not parse pointer %s", parameter);
+        return false;
+    }
+
+    *address = *value;
+    free(value);
+    return true;
+}
+
+// Find the size of each element of type, and the details needed to convert it.
+static bool decode_view_type(struct view *view, const char *type)
+{
+    if (sized_type_prefix(type)) {
+        if (decode_sized_type(type, &view->size, NULL) != true)
+            return false;
+
+        // The type is just the prefix and size, e.g. hex:16.
+        if (strchr(strchr(type, ':') + 1, ':')) {
+            builtin_error("the type %s should not include a value", type);
+            return false;
+        }
+
+        view->type = strdup(type);
+        return true;
+    }
+
+    if (decode_type_prefix(type, NULL, &view->ffitype, NULL, &view->format) != true)
+        return false;
+
+    if (view->ffitype == &ffi_type_void) {
+        builtin_error("cannot create a view of void");
+        return false;
+    }
+
+    view->size = view->ffitype->size;
+    view->type = strdup(type);
+    return true;
+}
+
+// Usage:
+//
+//  dlview -t type -n count pointer name
+//  dlview -u name
+//  dlview -d name
+//
+static int create_native_view(WORD_LIST *list)
+{
+    struct view *view;
+    struct view **prev;
+    unsigned long count;
+    char *detach;
+    char *sync;
+    char *type;
+    uint8_t *address;
+    SHELL_VAR *var;
+    int opt;
+
+    count   = 0;
+    type    = NULL;
+    detach  = NULL;
+    sync    = NULL;
+
+    reset_internal_getopt();
+
+    while ((opt = internal_getopt(list, "t:n:d:u:")) != -1) {
+        switch (opt) {
+            case 't':
+                type = list_optarg;
+                break;
+            case 'n':
+                if (check_parse_ulong(list_optarg, &count) != true || count == 0) {
+                    builtin_error("failed to parse `%s`, expected a count", list_optarg);
+                    return EX_USAGE;
+                }
+                break;
+            case 'd':
+                detach = list_optarg;
+                break;
+            case 'u':
+                sync = list_optarg;
+                break;
+            default:
+                builtin_usage();
+                return EX_USAGE;
+        }
+    }
+
+    // Skip past any options.
+    list = loptend;
+
+    release_stale_views();
+
+    if (sync) {
+        if (list || type || count || detach) {
+            builtin_usage();
+            return EX_USAGE;
+        }
+
+        if (!(prev = find_named_view(sync)))
+            return EXECUTION_FAILURE;
+
+        sync_view(*prev);
+        return EXECUTION_SUCCESS;
+    }
+
+    if (detach) {
+        if (list || type || count) {
+            builtin_usage();
+            return EX_USAGE;
+        }
+
+        if (!(prev = find_named_view(detach)))
+            return EXECUTION_FAILURE;
+
+        view  = *prev;
+        *prev = view->next;
+
+        destroy_view(view);
+        unbind_variable(detach);
+        return EXECUTION_SUCCESS;
+    }
+
+    if (!list || !list->next || list->next->next || !type || !count) {
+        builtin_usage();
+        return EX_USAGE;
+    }
+
+    if (!legal_identifier(list->next->word->word)) {
+        builtin_error("`%s': not a valid identifier", list->next->word->word);
+        return EXECUTION_FAILURE;
+    }
+
+    if (decode_view_address(list->word->word, &address) != true)
+        return EXECUTION_FAILURE;
+
+    if (!(view = calloc(1, sizeof *view))) {
+        builtin_error("failed to allocate a view");
+        return EXECUTION_FAILURE;
+    }
+
+    if (decode_view_type(view, type) != true) {
+        destroy_view(view);
+        return EXECUTION_FAILURE;
+    }
+
+    if (!(view->shadow = calloc(count, view->size))) {
+        builtin_error("failed to allocate a view of %lu elements", count);
+        destroy_view(view);
+        return EXECUTION_FAILURE;
+    }
+
+    // Replace any existing variable, rather than shadowing it.
+    unbind_variable(list->next->word->word);
+
+    if (!(var = make_new_array_variable(list->next->word->word))) {
+        builtin_error("failed to create array %s", list->next->word->word);
+        destroy_view(view);
+        return EXECUTION_FAILURE;
+    }
+
+    // The variable may have replaced a view, which is now stale.
+    release_stale_views();
+
+    view->name      = strdup(var->name);
+    view->var       = var;
+    view->address   = address;
+    view->count     = count;
+    view->next      = views;
+
+    var->assign_func    = assign_view;
+
+    views = view;
+
+    sync_view(view);
+    return EXECUTION_SUCCESS;
+}
+
+static char *dlview_usage[] = {
+    "Create an array backed by native memory.",
+    "",
+    "The indexed array name is created as a view of count elements of type",
+    "at pointer, and assigning an element writes it directly to native memory.",
+    "The type can be any primitive or sized type, and the prefix can be",
+    "omitted when assigning.",
+    "",
+    "Every element is converted when the view is created. Changes made to the",
+    "memory in any other way, e.g. by dlcall, are not visible until dlview -u",
+    "updates the array, which only converts elements that have changed. It",
+    "also restores elements removed by unset or a compound assignment.",
+    "",
+    "Usage:",
+    "",
+    "    $ dlcall -r pointer -n data calloc 1024 4",
+    "    $ dlview -t int32 -n 1024 $data values",
+    "    $ values[10]=42",
+    "    $ echo ${values[10]}",
+    "    int32:42",
+    "    $ dlcall memset $data 0 4096",
+    "    $ dlview -u values",
+    "",
+    "The memory must remain valid while the view exists. Unset the variable,",
+    "or use dlview -d, when it's no longer needed.",
+    "",
+    "Options:",
+    "    -t type     The type of each element, e.g. int32 or hex:16.",
+    "    -n count    The number of elements.",
+    "    -u name     Update the view name from native memory.",
+    "    -d name     Remove the view name.",
+    "",
+    "Exit Status:",
+    "The return code is zero, unless pointer or type could not be parsed, or",
+    "name is not a view.",
+    NULL,
+};
+
+struct builtin __attribute__((visibility("default"))) dlview_struct = {
+    .name       = "dlview",
+    .function   = create_native_view,
+    .flags      = BUILTIN_ENABLED,
+    .long_doc   = dlview_usage,
+    .short_doc  = "dlview -t type -n count pointer name or dlview -u|-d name",
+    .handle     = NULL,
+};
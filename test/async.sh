@@ -0,0 +1,66 @@
+#!/bin/bash
+#
+# Test asynchronous calls with dlcall -A and dlwait.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+# Several slow calls should overlap, rather than run one after another.
+declare -i start=$SECONDS
+
+dlcall -A a -n first  -r int usleep 1000000 || failure
+dlcall -A b -n second -r int usleep 1000000 || failure
+dlcall -A c -n third  -r int usleep 1000000 || failure
+
+dlwait a b c || failure
+
+if ((SECONDS - start > 2)); then
+    failure
+fi
+
+if test "$first $second $third" != "int:0 int:0 int:0"; then
+    failure
+fi
+
+# Jobs can only be collected once.
+dlwait a 2> /dev/null && failure
+
+# Results should be collected in the order they complete.
+dlcall -A slow -n slowret -r int usleep 500000
+dlcall -A fast -n fastret -r long labs long:-1000
+
+dlwait -n -v id || failure
+test "$id" == "$fast" || failure
+test "$fastret" == "long:1000" || failure
+
+dlwait || failure
+test "$slowret" == "int:0" || failure
+
+# Nothing left to wait for.
+dlwait -n 2> /dev/null && failure
+
+# Completion should be visible on DLJOBFD.
+dlcall -A job -r int getpid
+read -t 5 -u $DLJOBFD || failure
+dlwait job || failure
+
+# Subshells start their own workers, and don't inherit outstanding calls.
+dlcall -A outer -r int usleep 100000
+timeout 10 bash -c '
+    source ctypes.sh
+    dlcall -A first -r int getpid
+    dlwait first
+    ( dlcall -A inner -n result -r long labs long:-5
+      dlwait inner && test "$result" == "long:5" )' || failure
+( dlcall -A inner -n result -r long labs long:-5
+  dlwait inner && test "$result" == "long:5" ) || failure
+( dlwait $outer 2> /dev/null ) && failure
+dlwait outer || failure
+
+echo PASS
@@ -0,0 +1,55 @@
+#!/bin/bash
+#
+# Test native functions can be bound to builtins with dlbind.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+# Bind several functions at once.
+dlbind -r long strlen string \; -r int -n cabs abs int || failure
+
+strlen "hello world" || failure
+test "$DLRETVAL" == "long:11" || failure
+
+# Prefixes are optional, but accepted.
+cabs -42 || failure
+test "$DLRETVAL" == "int:42" || failure
+cabs int:-7 || failure
+test "$DLRETVAL" == "int:7" || failure
+
+# The number of parameters is checked.
+strlen 2> /dev/null && failure
+cabs 1 2 2> /dev/null && failure
+cabs notanumber 2> /dev/null && failure
+
+# Bindings should appear in help.
+help strlen | grep -q "strlen string" || failure
+
+# Rebinding replaces the previous builtin.
+dlbind -r int -n cabs labs long || failure
+cabs -9 || failure
+test "$DLRETVAL" == "int:9" || failure
+
+# Structure results work like dlcall.
+declare -a div_t=(int int)
+dlbind -r struct:div_t div int int || failure
+div 7 2 || failure
+test "${div_t[*]}" == "int:3 int:1" || failure
+
+# Existing builtins cannot be replaced, and bad signatures bind nothing.
+dlbind -r int -n echo abs int 2> /dev/null && failure
+dlbind -r int abs int \; -r int nosuchsymbol 2> /dev/null && failure
+type -t abs > /dev/null && failure
+
+# Builtins can be removed.
+dlbind -d strlen cabs div || failure
+type -t strlen > /dev/null && failure
+dlbind -d echo 2> /dev/null && failure
+
+echo PASS
@@ -0,0 +1,125 @@
+#!/bin/bash
+#
+# Test named native buffers.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+# New buffers are zeroed.
+buf data 8 || failure
+test "${data[1]}" -eq 8 || failure
+declare -a bytes=(uint8 uint8 uint8 uint8)
+unpack $data bytes || failure
+test "${bytes[*]}" == "uint8:0 uint8:0 uint8:0 uint8:0" || failure
+
+bytes=(uint8:1 uint8:2 uint8:3 uint8:4)
+pack $data bytes || failure
+
+# Resizing preserves the contents, within and beyond the size class.
+buf -r data 12 || failure
+test "${data[1]}" -eq 12 || failure
+unpack $data bytes || failure
+test "${bytes[*]}" == "uint8:1 uint8:2 uint8:3 uint8:4" || failure
+
+buf -r data 100000 || failure
+unpack $data bytes || failure
+test "${bytes[*]}" == "uint8:1 uint8:2 uint8:3 uint8:4" || failure
+buf -r data 8 || failure
+
+# Slices are views of the same memory, and follow their buffer.
+buf -s data 2 2 middle || failure
+test "${middle[1]}" -eq 2 || failure
+declare -a two=(uint8 uint8)
+unpack $middle two || failure
+test "${two[*]}" == "uint8:3 uint8:4" || failure
+
+buf -r data 1000 || failure
+unpack $middle two || failure
+test "${two[*]}" == "uint8:3 uint8:4" || failure
+
+buf -r data 3 2> /dev/null && failure
+buf -r middle 1 2> /dev/null && failure
+buf -s data 999 2 past 2> /dev/null && failure
+
+# Copy and zero.
+buf copy 2 || failure
+buf -c middle copy || failure
+unpack $copy two || failure
+test "${two[*]}" == "uint8:3 uint8:4" || failure
+buf -c data copy 2> /dev/null && failure
+
+buf -z middle || failure
+unpack $data bytes || failure
+test "${bytes[*]}" == "uint8:1 uint8:2 uint8:0 uint8:0" || failure
+
+# Freeing a buffer frees its slices.
+buf -d data || failure
+test -z "$data" || failure
+test -z "$middle" || failure
+buf -d middle 2> /dev/null && failure
+
+# Freed memory is reused.
+buf first 32 || failure
+address=$first
+buf -d first || failure
+buf second 24 || failure
+test "$second" == "$address" || failure
+
+# Freeing an arena frees everything in it.
+buf -a request input 64 || failure
+buf -a request output 200000 || failure
+buf -s input 0 8 header || failure
+buf -a request | grep -q "^input  *request  *64  " || failure
+test "$(buf -a request | wc -l)" -eq 4 || failure
+buf -F request || failure
+test -z "$input$output$header" || failure
+buf -a request 2> /dev/null && failure
+buf | grep -q "^second " || failure
+
+# Buffers work anywhere a pointer does.
+buf text 16 || failure
+dlcall -r pointer strcpy $text string:hello || failure
+dlcall -r long -n length strlen $text || failure
+test "$length" == "long:5" || failure
+
+# In a function, the variable is local, and a global is not replaced.
+function scoped ()
+{
+    local inner
+    buf inner 16 || return 1
+    buf -r inner 32 || return 1
+    test "${inner[1]}" == "32" || return 1
+    buf implicit 8 || return 1
+    test -n "$implicit"
+}
+
+inner=kept
+scoped || failure
+test "$inner" == "kept" || failure
+declare -p implicit 2> /dev/null && failure
+buf -d inner implicit || failure
+test "$inner" == "kept" || failure
+
+# Errors.
+buf > /dev/null || failure
+buf nosize 2> /dev/null && failure
+buf bad size 2> /dev/null && failure
+buf -z nosuchbuffer 2> /dev/null && failure
+buf -F nosucharena 2> /dev/null && failure
+buf -d -z text 2> /dev/null && failure
+
+# Failed allocations leave any existing buffer intact.
+buf huge 99999999999999999 2> /dev/null && failure
+test -z "$huge" || failure
+buf text 99999999999999999 2> /dev/null && failure
+buf -r text 99999999999999999 2> /dev/null && failure
+dlcall -r long -n length strlen $text || failure
+test "$length" == "long:5" || failure
+
+echo PASS
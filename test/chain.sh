@@ -0,0 +1,42 @@
+#!/bin/bash
+#
+# Test executing chains of calls with dlchain.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+# Allocate, fill, call and free in one command.
+dlchain -a r -r pointer calloc 1 64                     \; \
+              -r pointer strcpy '$0' "hello, world"     \; \
+              -r long strlen '$1'                       \; \
+              free '$0' || failure
+
+test "${r[2]}" == "long:12" || failure
+test "${r[0]}" == "${r[1]}" || failure
+test -z "${r[3]}" || failure
+
+# Only the final result should be bound by default.
+dlchain -n result -r long labs long:-5 \; -r long labs '$0' || failure
+test "$result" == "long:5" || failure
+
+# References can be used more than once, and in any position.
+dlchain -r int abs int:-16 \; -r long strtol string:ff pointer:0 '$0' || failure
+test "$DLRETVAL" == "long:255" || failure
+
+# Invalid chains should be rejected before anything is executed.
+unset result
+dlchain -n result -r int abs -1 \; -r int abs '$1' 2> /dev/null && failure
+dlchain -n result -r int abs -1 \; free '$5' 2> /dev/null && failure
+dlchain -n result free pointer:0 \; -r int abs '$0' 2> /dev/null && failure
+dlchain -n result -r int abs -1 \; _invalid_symbol_name_ 2> /dev/null && failure
+dlchain -n result -r int abs -1 \; \; -r int abs -1 2> /dev/null && failure
+dlchain -n result -r int abs -1 \; -x int abs -1 2> /dev/null && failure
+test -z "$result" || failure
+
+echo PASS
@@ -0,0 +1,143 @@
+#!/bin/bash
+#
+# Test packing and unpacking arrays of records into an array per member.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+declare -ri POLLIN=1
+declare -ri POLLOUT=4
+
+# struct pollfd, the members of an indexed layout are named by index.
+declare -a pollfd=(int short short)
+declare -a fds=(int int)
+
+dlcall -r int pipe out:struct:pipe=fds || failure
+
+buf records 24 || failure
+
+poll_0=(${fds[0]} ${fds[1]} int:-1)
+poll_1=(short:$POLLIN short:$POLLOUT short:$POLLIN)
+pack -N 3 $records pollfd poll || failure
+
+dlcall -r int poll $records 3 0 || failure
+test "$DLRETVAL" == "int:1" || failure
+
+unset poll_0 poll_1 poll_2
+unpack -N 3 $records pollfd poll || failure
+test "${poll_0[*]}" == "${fds[0]} ${fds[1]} int:-1" || failure
+test "${poll_1[*]}" == "short:$POLLIN short:$POLLOUT short:$POLLIN" || failure
+test "${poll_2[*]}" == "short:0 short:$POLLOUT short:0" || failure
+
+# Only members with an array, and elements with a value, are packed.
+unset poll_0 poll_2
+poll_1=([1]=$((POLLIN | POLLOUT)))
+dlcall -r long write ${fds[1]} string:x long:1
+pack -N 3 $records pollfd poll || failure
+dlcall -r int poll $records 3 0 || failure
+test "$DLRETVAL" == "int:2" || failure
+unpack -N 3 $records pollfd poll || failure
+test "${poll_1[*]}" == "short:$POLLIN short:$((POLLIN | POLLOUT)) short:$POLLIN" || failure
+test "${poll_2[*]}" == "short:$POLLIN short:$POLLOUT short:0" || failure
+
+# Names are sanitized. The order of an associative array is not preserved,
+# so every member of each record has the same value.
+declare -a values=(int:7 int:7 int:7 int:8 int:8 int:8)
+pack $records values || failure
+declare -A layout
+layout[fd]=int
+layout[events.__pad0]=int
+layout[a[0]]=int
+unpack -N 2 $records layout poll 2> /dev/null || failure
+test "${poll_fd[*]}" == "int:7 int:8" || failure
+test "${poll_a_0_[*]}" == "int:7 int:8" || failure
+test -z "${poll_events___pad0[*]}" || failure
+
+# A stride skips the remainder of each record.
+declare -a wide=(int)
+unpack -N 2 -S 12 $records wide fd || failure
+test "${fd_0[*]}" == "int:7 int:8" || failure
+
+# Sized types are a single column.
+declare -a names=(chars:4 hex:2)
+poll_0=(abc xyz)
+poll_1=(hex:2:0102 ffff)
+pack -N 2 $records names poll || failure
+unpack -N 2 $records names poll || failure
+test "${poll_0[*]}" == "chars:4:abc chars:4:xyz" || failure
+test "${poll_1[*]}" == "hex:2:0102 hex:2:ffff" || failure
+
+poll_1=(hex:3:010203)
+pack -N 1 $records names poll 2> /dev/null && failure
+poll_1=(int:1)
+pack -N 1 $records pollfd poll 2> /dev/null && failure
+
+# Linked lists are followed until a NULL pointer, or the maximum count.
+buf nodes 48 || failure
+declare -a node=(pointer int int)
+declare -i base=$(printf %d ${nodes##*:})
+list_0=(pointer:$(printf %#x $((base + 32))) pointer:0 pointer:$(printf %#x $((base + 16))))
+list_1=(10 30 20)
+pack -N 3 $nodes node list || failure
+unset list_0 list_1
+unpack -N 10 -L 0 $nodes node list || failure
+test "${list_1[*]}" == "int:10 int:20 int:30" || failure
+test "${#list_0[@]}" -eq 3 || failure
+unset list_0
+unpack -N 2 -L 0 -f 1 $nodes node list || failure
+test "${list_1[*]}" == "int:10 int:20" || failure
+test -z "${list_0[*]}" || failure
+
+list_2=(1 2 3)
+pack -N 10 -L 0 -f 2 $nodes node list || failure
+unpack -N 3 $nodes node list || failure
+test "${list_2[*]}" == "int:1 int:3 int:2" || failure
+test "${list_1[*]}" == "int:10 int:30 int:20" || failure
+
+unpack -N 10 -L 1 $nodes node list 2> /dev/null && failure
+unpack -N 10 -L 9 $nodes node list 2> /dev/null && failure
+unpack -L 0 $nodes node list 2> /dev/null && failure
+unpack -N 10 -L 0 -S 16 $nodes node list 2> /dev/null && failure
+buf -d nodes
+
+# Lists from native functions match walking them one record at a time. This
+# is struct addrinfo on LP64, with the padding before ai_addr.
+buf result 8 || failure
+dlcall -r int -n ret getaddrinfo string:localhost $NULL $NULL $result || failure
+test "$ret" == "int:0" || failure
+declare -a head=(pointer)
+unpack $result head || failure
+declare -a addrinfo=(int int int int unsigned int pointer pointer pointer)
+unpack -N 64 -L 8 -f 1,2,4,6 $head addrinfo address || failure
+
+record=${head[0]}
+for ((i = 0; ; i++)); do
+    unpack $record addrinfo || failure
+    test "${addrinfo[1]} ${addrinfo[2]}" == "${address_1[i]} ${address_2[i]}" || failure
+    test "${addrinfo[4]} ${addrinfo[6]}" == "${address_4[i]} ${address_6[i]}" || failure
+    test "${addrinfo[8]}" == "$NULL" && break
+    record=${addrinfo[8]}
+done
+test $((i + 1)) -eq ${#address_1[@]} || failure
+test -z "${address_8[*]}" || failure
+
+dlcall freeaddrinfo ${head[0]}
+buf -d result
+
+unpack -N 0 $records pollfd poll 2> /dev/null && failure
+unpack -N 1 $records pollfd 2> /dev/null && failure
+unpack -N 1 $records pollfd bad-name 2> /dev/null && failure
+unpack -S 8 $records pollfd 2> /dev/null && failure
+unpack -N 1 $records nosuchlayout poll 2> /dev/null && failure
+
+dlcall close ${fds[0]}
+dlcall close ${fds[1]}
+buf -d records
+
+echo PASS
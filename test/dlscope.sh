@@ -0,0 +1,122 @@
+#!/bin/bash
+#
+# Test allocations are released with their scope.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+# sizeof is only available with struct support, so those checks are skipped
+# without it.
+type -t sizeof > /dev/null && structs=1
+
+# Outside a scope, buffers use the default arena.
+buf outside 8 || failure
+buf -a default | grep -q "^outside " || failure
+
+dlscope begin || failure
+test "$(dlscope)" == "dlscope.1" || failure
+buf inside 8 || failure
+buf -a dlscope.1 | grep -q "^inside " || failure
+
+if test -n "$structs"; then
+    sizeof -m intptr int > /dev/null || failure
+    buf -a dlscope.1 | grep -q "^intptr  *dlscope.1  *4 " || failure
+fi
+
+dlscope end || failure
+
+test -z "$inside$intptr" || failure
+test -n "$outside" || failure
+test -z "$(dlscope)" || failure
+dlscope end 2> /dev/null && failure
+
+# A scope begun in a function ends when it returns, even on an error path.
+function allocate {
+    dlscope begin
+    buf scratch 64
+    test -n "$structs" && sizeof -m number long > /dev/null
+    test "$(dlscope | wc -l)" -eq 1 || failure
+    test -n "$scratch$number" || failure
+    return 1
+}
+
+allocate && failure
+dlscope > /dev/null || failure
+test -z "$scratch$number" || failure
+test -z "$(dlscope)" || failure
+
+# Memory stays bounded when called in a loop, allocate checks there is only
+# ever one scope.
+for ((i = 0; i < 100; i++)); do
+    allocate
+done
+
+dlscope > /dev/null || failure
+test -z "$(buf | grep dlscope)" || failure
+
+# Inner scopes that are not ended are released with the outer scope.
+function nested {
+    dlscope begin
+    buf outer 8
+    dlscope begin
+    buf inner 8
+    test "$(dlscope | wc -l)" -eq 2 || failure
+}
+
+nested
+dlscope > /dev/null || failure
+test -z "$outer$inner" || failure
+test -z "$(dlscope)" || failure
+
+# Ending a scope early is fine.
+function early {
+    dlscope begin
+    buf temporary 8
+    dlscope end
+    test -z "$temporary" || failure
+}
+
+dlscope begin
+buf kept 8
+early
+test -n "$kept" || failure
+test "$(dlscope | wc -l)" -eq 1 || failure
+dlscope end
+test -z "$kept" || failure
+
+# Releasing a scope only unsets its own buffers, not a variable with the same
+# name in the function that happens to release it.
+function bufferscope {
+    dlscope begin
+    local p
+    buf p 16
+}
+
+function samename {
+    local p=mine
+    buf q 8
+    result=$p
+    buf -d q
+}
+
+bufferscope
+samename
+test "$result" == "mine" || failure
+
+# Allocations outside a scope are unaffected.
+if test -n "$structs"; then
+    sizeof -m plain int > /dev/null || failure
+    dlcall free $plain || failure
+fi
+
+test -n "$outside" || failure
+
+dlscope invalid 2> /dev/null && failure
+
+echo PASS
@@ -0,0 +1,109 @@
+#!/bin/bash
+#
+# Test native calls are profiled by dlstat.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+# Nothing is recorded until profiling is enabled.
+dlcall -r long strlen string:hello
+dlstat -a stats || failure
+test -z "${stats[strlen.calls]}" || failure
+
+dlstat -e || failure
+
+for ((i = 0; i < 10; i++)); do
+    dlcall -r long strlen string:hello || failure
+done
+
+dlcall -r int abs int:-1 || failure
+
+dlstat -a stats || failure
+test "${stats[strlen.calls]}" == "10" || failure
+test "${stats[abs.calls]}" == "1" || failure
+
+# Every phase should have been timed.
+for phase in decode call bind; do
+    test "${stats[strlen.$phase.total]}" -gt 0 || failure
+    test "${stats[strlen.$phase.min]}" -le "${stats[strlen.$phase.max]}" || failure
+    test "${stats[strlen.$phase.max]}" -le "${stats[strlen.$phase.total]}" || failure
+done
+
+# Percentiles are ordered, and bounded by the minimum and maximum.
+for phase in decode call bind; do
+    test "${stats[strlen.$phase.min]}" -le "${stats[strlen.$phase.p50]}" || failure
+    test "${stats[strlen.$phase.p50]}" -le "${stats[strlen.$phase.p99]}" || failure
+    test "${stats[strlen.$phase.p99]}" -le "${stats[strlen.$phase.p999]}" || failure
+    test "${stats[strlen.$phase.p999]}" -le "${stats[strlen.$phase.max]}" || failure
+done
+
+# A single stall should show up in the tail, but not the median.
+dlstat -r || failure
+
+for ((i = 0; i < 99; i++)); do
+    dlcall -r int usleep int:0 || failure
+done
+
+dlcall -r int usleep int:20000 || failure
+dlstat -a stats || failure
+test "${stats[usleep.calls]}" == "100" || failure
+test "${stats[usleep.call.p50]}" -lt 10000000 || failure
+test "${stats[usleep.call.p999]}" -ge 18000000 || failure
+test "${stats[usleep.call.max]}" -ge 20000000 || failure
+
+dlstat -r || failure
+
+for ((i = 0; i < 10; i++)); do
+    dlcall -r long strlen string:hello || failure
+done
+
+dlcall -r int abs int:-1 || failure
+
+# Builtins and callbacks are recorded by name.
+declare -a buf=(int int)
+dlcall -r pointer -n ptr calloc 1 8
+pack $ptr buf || failure
+unpack $ptr buf || failure
+
+function compare {
+    return 0
+}
+
+callback -n cmp compare int pointer pointer
+dlcall qsort $ptr long:2 long:4 $cmp
+dlcall free $ptr
+
+dlbind -r int -n cabs abs int || failure
+cabs -1 || failure
+
+dlstat -a stats || failure
+test "${stats[pack.calls]}" == "1" || failure
+test "${stats[unpack.calls]}" == "1" || failure
+test "${stats[compare.calls]}" == "1" || failure
+test "${stats[cabs.calls]}" == "1" || failure
+
+# The report should have a line for each phase of each symbol.
+dlstat | grep -q "^symbol" || failure
+dlstat | grep -q "^strlen  *10  decode " || failure
+test "$(dlstat | wc -l)" -eq $((1 + 3 * 9)) || failure
+
+# Disabling keeps existing statistics.
+dlstat -d || failure
+dlcall -r long strlen string:hello
+dlstat -a stats || failure
+test "${stats[strlen.calls]}" == "10" || failure
+
+# Reset discards everything.
+dlstat -r || failure
+dlstat -a stats || failure
+test "${#stats[@]}" -eq 0 || failure
+
+dlstat invalid 2> /dev/null && failure
+
+echo PASS
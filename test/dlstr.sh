@@ -0,0 +1,148 @@
+#!/bin/bash
+#
+# Test copying strings between native memory and variables.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+buf text 16 || failure
+
+# Strings are written with a terminator, and read back up to it.
+dlstr -w -n written $text "hello world" || failure
+test "$written" -eq 11 || failure
+dlcall -r long -n length strlen $text || failure
+test "$length" == "long:11" || failure
+dlstr $text || failure
+test "$DLRETVAL" == "hello world" || failure
+dlstr -n result $text || failure
+test "$result" == "hello world" || failure
+
+# A length reads at most that many bytes, or up to the terminator.
+dlstr -n result $text 5 || failure
+test "$result" == "hello" || failure
+dlstr -n result $text 100 || failure
+test "$result" == "hello world" || failure
+dlstr -n result $text 0 || failure
+test -z "$result" || failure
+
+# Without a terminator, the rest of the string remains.
+dlstr -w -N $text "HELLO" || failure
+dlstr -n result $text || failure
+test "$result" == "HELLO world" || failure
+
+# The size includes the terminator, like strlcpy.
+dlstr -w -l 4 -n written $text "goodbye" || failure
+test "$written" -eq 3 || failure
+dlstr -n result $text || failure
+test "$result" == "goo" || failure
+dlstr -n result ${text[0]} 16 || failure
+test "$result" == "goo" || failure
+
+dlstr -w -N -l 2 $text "xyz" || failure
+dlstr -n result $text || failure
+test "$result" == "xyo" || failure
+
+# Strings from native functions can be read directly.
+dlcall -r pointer -n dup strdup string:native || failure
+dlstr -n result $dup || failure
+test "$result" == "native" || failure
+dlcall free $dup
+
+# Only pointers are accepted.
+dlstr int:1 2> /dev/null && failure
+dlstr 2> /dev/null && failure
+dlstr -l 4 $text 2> /dev/null && failure
+dlstr -w $text 2> /dev/null && failure
+
+# Sized types pack and unpack a run of bytes as one element.
+declare -a fields=(chars:8:hello hex:4:00ff7f10 int:-1)
+pack $text fields || failure
+dlstr -n result $text || failure
+test "$result" == "hello" || failure
+fields=(chars:8 hex:4 int)
+unpack $text fields || failure
+test "${fields[*]}" == "chars:8:hello hex:4:00ff7f10 int:-1" || failure
+fields=(chars:3 hex:2)
+unpack $text fields || failure
+test "${fields[*]}" == "chars:3:hel hex:2:6c6f" || failure
+
+# Long values are converted 16 bytes at a time.
+buf block 64 || failure
+hex=000102030405060708090a0b0c0d0e0f10111213ff7f80fe2021222324252627deadbeef
+fields=(hex:36:$hex)
+pack $block fields || failure
+fields=(hex:36)
+unpack $block fields || failure
+test "${fields[0]}" == "hex:36:$hex" || failure
+fields=(hex:36:${hex^^})
+pack $block fields || failure
+fields=(hex:36)
+unpack $block fields || failure
+test "${fields[0]}" == "hex:36:$hex" || failure
+fields=(hex:36:${hex/ff/fg})
+pack $block fields 2> /dev/null && failure
+fields=(hex:36:${hex/20/2:})
+pack $block fields 2> /dev/null && failure
+
+# Base64 is padded, and may be packed without padding.
+fields=(base64:4:3q2+7w== uint8:0 uint8:0)
+pack $block fields || failure
+fields=(hex:6)
+unpack $block fields || failure
+test "${fields[0]}" == "hex:6:deadbeef0000" || failure
+fields=(base64:1 base64:2 base64:3)
+unpack $block fields || failure
+test "${fields[*]}" == "base64:1:3g== base64:2:rb4= base64:3:7wAA" || failure
+fields=(base64:3:AQID)
+pack $block fields || failure
+fields=(uint8 uint8 uint8)
+unpack $block fields || failure
+test "${fields[*]}" == "uint8:1 uint8:2 uint8:3" || failure
+fields=(base64:3:AQIDBA)
+pack $block fields 2> /dev/null && failure
+fields=(base64:3:AQ.D)
+pack $block fields 2> /dev/null && failure
+buf -d block
+
+# Sized types are passed to functions as a pointer to a copy.
+dlcall -r int memcmp hex:4:deadbeef base64:4:3q2+7w== 4 || failure
+test "$DLRETVAL" == "int:0" || failure
+dlcall -r long strlen chars:16:hello || failure
+test "$DLRETVAL" == "long:5" || failure
+dlcall -r int memcmp hex:99999999999999999 hex:1 1 2> /dev/null && failure
+
+# Values must fit in the size.
+fields=(chars:2:hello)
+pack $text fields 2> /dev/null && failure
+fields=(hex:1:abcd)
+pack $text fields 2> /dev/null && failure
+fields=(hex:2:xyz0)
+pack $text fields 2> /dev/null && failure
+fields=(chars:0)
+unpack $text fields 2> /dev/null && failure
+
+# A hex element is the same as unpacking each byte and formatting it.
+fields=(chars:16:"hello world")
+pack $text fields || failure
+declare -a bytes=(uint8:{1..16})
+unpack $text bytes || failure
+fields=(hex:16)
+unpack $text fields || failure
+test "${fields##*:}" == "$(printf %02x ${bytes[*]##*:})" || failure
+
+# NULL pointers are rejected, rather than read or written.
+DLRETVAL=unchanged
+dlstr pointer:0 2> /dev/null && failure
+dlstr pointer:0 5 2> /dev/null && failure
+dlstr -w pointer:0 hi 2> /dev/null && failure
+test "$DLRETVAL" == "unchanged" || failure
+
+buf -d text
+
+echo PASS
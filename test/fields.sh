@@ -0,0 +1,71 @@
+#!/bin/bash
+#
+# Test packing and unpacking only some members of a layout.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+buf record 16 || failure
+
+declare -a values=(int:1 int:2 long:3)
+pack $record values || failure
+
+# Only the selected members are decoded, the rest are unchanged.
+declare -a layout=(int int:9 long)
+unpack -f 0,2 $record layout || failure
+test "${layout[*]}" == "int:1 int:9 long:3" || failure
+
+# Unselected members are not written.
+layout=(int:7 int:8 long)
+pack -f 1 $record layout || failure
+unpack $record values || failure
+test "${values[*]}" == "int:1 int:8 long:3" || failure
+
+# Members without a value are zero.
+pack -f 2 $record layout || failure
+unpack $record values || failure
+test "${values[*]}" == "int:1 int:8 long:0" || failure
+
+# Sized types can be selected.
+declare -a text=(chars:4 chars:4:abc)
+pack -f 1 $record text || failure
+text=(hex:4 chars:4)
+unpack -f 1 $record text || failure
+test "${text[*]}" == "hex:4 chars:4:abc" || failure
+
+# A nested structure or array selects all of its members, and nothing else.
+# The order of an associative array is not preserved, so every member has the
+# same value.
+values=(int:5 int:5 int:5 int:5)
+pack $record values || failure
+declare -A nested
+nested[a.x]=int
+nested[a.y]=int
+nested[ab]=int
+nested[c[0]]=int
+unpack -f a,c $record nested 2> /dev/null || failure
+test "${nested[a.x]}" == "int:5" || failure
+test "${nested[a.y]}" == "int:5" || failure
+test "${nested[ab]}" == "int" || failure
+test "${nested[c[0]]}" == "int:5" || failure
+
+# With -N, only the selected columns are created.
+declare -a pair=(int int)
+unpack -N 2 -f 1 $record pair column || failure
+test "${column_1[*]}" == "int:5 int:5" || failure
+test -z "${column_0[*]}" || failure
+
+unpack -f 3 $record layout 2> /dev/null && failure
+unpack -f a.z $record nested 2> /dev/null && failure
+layout=(int int:x long)
+pack -f 1 $record layout 2> /dev/null && failure
+
+buf -d record
+
+echo PASS
@@ -0,0 +1,123 @@
+#!/bin/bash
+#
+# Generate a shared library with a large amount of debug information, for
+# benchmarking the DWARF loader used by struct and sizeof.
+#
+# Every compilation unit defines a chain of nested structures, unions,
+# typedefs, bitfields and arrays, and includes a common set of types, like a
+# real program including the same headers everywhere. The final unit defines
+# struct lasttype, which is the worst case for a lookup.
+#
+# usage: gendwarf.sh [-n units] [-d depth] [-j jobs] -o output.so
+#
+
+units=2000
+depth=8
+jobs=$(getconf _NPROCESSORS_ONLN 2> /dev/null || echo 1)
+output=
+CC=${CC:-cc}
+
+while getopts "n:d:j:o:" opt; do
+    case $opt in
+        n) units=$OPTARG;;
+        d) depth=$OPTARG;;
+        j) jobs=$OPTARG;;
+        o) output=$OPTARG;;
+        *) exit 1;;
+    esac
+done
+
+if [[ -z $output ]]; then
+    echo "usage: $0 [-n units] [-d depth] [-j jobs] -o output.so" 1>&2
+    exit 1
+fi
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT
+
+# The types shared by every unit.
+cat > "$workdir/common.h" <<HEADER
+#include <stdint.h>
+
+typedef uint32_t common_flags_t;
+
+struct common_list {
+    struct common_list *next;
+    struct common_list *prev;
+};
+
+struct common_header {
+    common_flags_t flags : 12;
+    common_flags_t type : 4;
+    common_flags_t size : 16;
+    struct common_list list;
+    union {
+        int64_t i;
+        double d;
+        void *p;
+    } value;
+};
+HEADER
+
+# Print the source for unit $1.
+function generate_unit ()
+{
+    local n=$1
+    local level
+
+    printf '#include "common.h"\n\n'
+    printf 'typedef unsigned int cu%u_bits_t;\n\n' $n
+    printf 'struct cu%u_leaf {\n' $n
+    printf '    cu%u_bits_t a : 3;\n' $n
+    printf '    cu%u_bits_t b : 5;\n' $n
+    printf '    cu%u_bits_t c : 24;\n' $n
+    printf '    char name[16];\n'
+    printf '    struct common_header header;\n'
+    printf '};\n\n'
+    printf 'union cu%u_variant {\n' $n
+    printf '    struct cu%u_leaf leaf;\n' $n
+    printf '    long raw[4];\n'
+    printf '    double real;\n'
+    printf '};\n\n'
+    printf 'typedef struct cu%u_level0 {\n' $n
+    printf '    struct cu%u_leaf leaf;\n' $n
+    printf '    union cu%u_variant variant;\n' $n
+    printf '} cu%u_level0_t;\n\n' $n
+
+    for ((level = 1; level <= depth; level++)); do
+        printf 'typedef struct cu%u_level%u {\n' $n $level
+        printf '    cu%u_level%u_t inner;\n' $n $((level - 1))
+        printf '    union {\n'
+        printf '        cu%u_level%u_t *ptr;\n' $n $((level - 1))
+        printf '        uintptr_t addr;\n'
+        printf '    } link;\n'
+        printf '    unsigned short depth : 4;\n'
+        printf '    unsigned short tag : 12;\n'
+        printf '    int counts[%u];\n' $((level + 1))
+        printf '} cu%u_level%u_t;\n\n' $n $level
+    done
+
+    # Types are only emitted if something uses them.
+    printf 'cu%u_level%u_t cu%u_instance;\n' $n $depth $n
+    printf 'struct common_header cu%u_header;\n' $n
+}
+
+for ((n = 0; n < units; n++)); do
+    generate_unit $n > "$workdir/cu$n.c"
+done
+
+cat >> "$workdir/cu$((units - 1)).c" <<LAST
+
+struct lasttype {
+    int first;
+    cu$((units - 1))_level${depth}_t nested;
+    unsigned last : 1;
+};
+
+struct lasttype lastinstance;
+LAST
+
+# Compile in parallel, then link everything together.
+(cd "$workdir" && ls cu*.c | xargs -P "$jobs" -n 16 $CC -g -O0 -fPIC -c) || exit 1
+
+$CC -shared -o "$output" "$workdir"/cu*.o
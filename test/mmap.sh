@@ -0,0 +1,85 @@
+#!/bin/bash
+#
+# Test files can be mapped and unpacked in place.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+file=$(mktemp)
+
+trap 'rm -f $file' EXIT
+
+printf 'ABCDEFGH' > $file
+
+dlmmap $file data || failure
+test "${#data[@]}" -eq 2 || failure
+test "${data[1]}" -eq 8 || failure
+
+declare -a bytes=(uint8 uint8 uint8)
+unpack $data bytes || failure
+test "${bytes[*]}" == "uint8:65 uint8:66 uint8:67" || failure
+
+dlmunmap data || failure
+test -z "${data}" || failure
+
+# Mapping again replaces the variable.
+dlmmap $file data || failure
+dlmmap -o 4 $file data || failure
+test "${data[1]}" -eq 4 || failure
+dlmunmap data || failure
+test -z "${data}" || failure
+
+# Unaligned offsets are handled.
+dlmmap -o 6 -a sequential -p $file data || failure
+test "${data[1]}" -eq 2 || failure
+declare -a two=(uint8 uint8)
+unpack $data two || failure
+test "${two[*]}" == "uint8:71 uint8:72" || failure
+
+# Unmapping by pointer leaves the variable alone.
+dlmunmap $data || failure
+test -n "${data}" || failure
+dlmunmap $data 2> /dev/null && failure
+
+# Writable mappings change the file.
+dlmmap -w $file data || failure
+two=(uint8:120 uint8:121)
+pack $data two || failure
+dlmunmap data || failure
+test "$(< $file)" == "xyCDEFGH" || failure
+
+# Copy on write mappings do not.
+dlmmap -c $file data || failure
+two=(uint8:65 uint8:66)
+pack $data two || failure
+dlmunmap data || failure
+test "$(< $file)" == "xyCDEFGH" || failure
+
+# Anonymous memory and memfd.
+dlmmap -A -l 4096 anon || failure
+test "${anon[1]}" -eq 4096 || failure
+pack $anon two || failure
+dlmunmap anon || failure
+
+dlmmap -M scratch -l 16 shared || failure
+test "${#shared[@]}" -eq 3 || failure
+two=(uint8:111 uint8:107)
+pack $shared two || failure
+test "$(head -c 2 /proc/$$/fd/${shared[2]##*:})" == "ok" || failure
+dlmunmap shared || failure
+
+# Errors.
+dlmmap /nonexistent data 2> /dev/null && failure
+dlmmap -a invalid $file data 2> /dev/null && failure
+dlmmap -A anon 2> /dev/null && failure
+dlmmap $file 2> /dev/null && failure
+dlmunmap nosuchvariable 2> /dev/null && failure
+dlmunmap pointer:0x1234 2> /dev/null && failure
+
+echo PASS
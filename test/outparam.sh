@@ -0,0 +1,56 @@
+#!/bin/bash
+#
+# Test out parameters are allocated and decoded by dlcall.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+# Primitive out parameters.
+dlcall -r long strtol string:1234xyz out:pointer=endptr int:10 || failure
+test "$DLRETVAL" == "long:1234" || failure
+
+dlcall -r int puts $endptr > /dev/null || failure
+test "$(dlcall puts $endptr)" == "xyz" || failure
+
+# Unnamed primitives should be stored in DLOUT.
+dlcall -r int sscanf string:"12 34" string:"%d %d" out:int out:int || failure
+test "$DLRETVAL" == "int:2" || failure
+test "${DLOUT[0]}" == "int:12" || failure
+test "${DLOUT[1]}" == "int:34" || failure
+
+# Any unpack layout can be used for a structure.
+declare -a fds=(int int)
+dlcall -r int pipe out:struct:pipe=fds || failure
+test "$DLRETVAL" == "int:0" || failure
+
+dlcall -r long write ${fds[1]} string:hello long:5
+dlcall -r long read ${fds[0]} out:struct:buf=buf long:5 2> /dev/null && failure
+
+declare -a buf=(char char char char char)
+dlcall -r long read ${fds[0]} out:struct:buf long:5 || failure
+test "$DLRETVAL" == "long:5" || failure
+test "$(printf %s ${buf[@]##*:})" == "hello" || failure
+
+# Sized types are stored as one value.
+dlcall -r long write ${fds[1]} hex:6:68656c6c6f00 long:6
+dlcall -r long read ${fds[0]} out:chars:8=text long:6 || failure
+test "$text" == "chars:8:hello" || failure
+dlcall -r long write ${fds[1]} string:hello long:5
+dlcall -r long read ${fds[0]} out:hex:5 long:5 || failure
+test "${DLOUT[0]}" == "hex:5:68656c6c6f" || failure
+
+dlcall close ${fds[0]}
+dlcall close ${fds[1]}
+
+# Invalid types should fail without calling anything.
+dlcall -r int puts out:invalid=x 2> /dev/null && failure
+dlcall -A job puts out:int 2> /dev/null && failure
+dlcall -r int puts out:hex:99999999999999999=x 2> /dev/null && failure
+
+echo PASS
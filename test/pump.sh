@@ -0,0 +1,42 @@
+#!/bin/bash
+#
+# Test feeding data into native consumers with dlpump.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+declare tmpfile=$(mktemp)
+
+trap 'rm -f $tmpfile' EXIT
+
+# write(fd, buffer, length) is a convenient consumer, it should copy the input
+# exactly. Use a small buffer to make sure multiple chunks work.
+dlpump -b 7 -n count write int:1 < /etc/passwd > $tmpfile || failure
+
+cmp -s /etc/passwd $tmpfile || failure
+
+test "$count" == "uint64:$(stat -c %s /etc/passwd)" || failure
+
+# Reading from another fd should work too.
+exec {fd}< /etc/passwd
+dlpump -f $fd write int:1 > $tmpfile || failure
+exec {fd}<&-
+
+cmp -s /etc/passwd $tmpfile || failure
+
+# An empty input should not call the consumer at all.
+dlpump -n count write int:1 < /dev/null > $tmpfile || failure
+test "$count" == "uint64:0" || failure
+test -s $tmpfile && failure
+
+# Invalid consumers and descriptors should fail cleanly.
+dlpump _invalid_symbol_name_ int:1 < /dev/null 2> /dev/null && failure
+dlpump -f 9999 write int:1 2> /dev/null && failure
+
+echo PASS
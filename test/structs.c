@@ -67,6 +67,12 @@ struct mixedpack {
 #pragma pack(pop)
 } mixedpack;
 
+struct hasstrings {
+    char name[16];
+    unsigned char digest[4];
+    int a;
+} hasstrings;
+
 // Things that might not work, but should in future and shouldn't crash.
 struct complexarray {
     int a[2][2][2];
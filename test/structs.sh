@@ -76,6 +76,69 @@ else
     echo PASS
 fi
 
+echo "Testing member offsets are used instead of padding..."
+
+struct manytypes manytypes
+
+manytypes[a]=uint8:1
+manytypes[b]=uint16:2
+manytypes[f]=float:6.000000
+manytypes[h]=pointer:0x8
+sizeof -m buffer manytypes
+pack $buffer manytypes
+declare -a raw=(uint8 uint8 uint16 uint32 uint64 double float uint32 pointer pointer)
+unpack $buffer raw
+
+if test "${#manytypes[@]}"      -ne 8                       \
+ || test "${raw[0]}"            != uint8:1                  \
+ || test "${raw[2]}"            != uint16:2                 \
+ || test "${raw[6]}"            != float:6.000000           \
+ || test "${raw[9]}"            != pointer:0x8; then
+    echo FAIL
+    exit 1
+fi
+
+unset manytypes
+struct manytypes manytypes
+unpack -f b,h $buffer manytypes
+manytypes[b]=uint16:3
+pack -f b $buffer manytypes
+unpack $buffer raw
+
+if test "${manytypes[b]}"       != uint16:3                 \
+ || test "${manytypes[h]}"      != pointer:0x8              \
+ || test "${manytypes[a]}"      != uint8                    \
+ || test "${raw[2]}"            != uint16:3                 \
+ || test "${raw[6]}"            != float:6.000000; then
+    echo FAIL
+    exit 1
+else
+    echo PASS
+fi
+
+echo "Testing offsets are only used by the layout they belong to..."
+
+declare -A copy
+for member in "${!manytypes[@]}"; do
+    copy[$member]=${manytypes[$member]}
+done
+manytypes[extra]=int
+
+if test "${#copy[@]}"           -ne 8                       \
+ || test "${#manytypes[@]}"     -ne 9                       \
+ || pack $buffer manytypes 2> /dev/null                     \
+ || unpack $buffer manytypes 2> /dev/null                   \
+ || ! pack $buffer copy                                     \
+ || ! struct manytypes manytypes                            \
+ || ! pack $buffer manytypes; then
+    echo FAIL
+    exit 1
+else
+    echo PASS
+fi
+
+dlcall free $buffer
+
 echo "Testing structs with arrays..."
 
 struct hasarray hasarray
@@ -91,6 +154,36 @@ else
     echo PASS
 fi
 
+echo "Testing char arrays as strings..."
+
+struct -s hasstrings hasstrings
+
+if ! compare_gdb_size hasstrings $(sizeof hasstrings)   \
+ || test "${hasstrings[name]}"      != chars:16         \
+ || test "${hasstrings[digest]}"    != hex:4            \
+ || test "${hasstrings[a]}"         != int              \
+ || ! test -z "${hasstrings[name[0]]}"; then
+    echo FAIL
+    exit 1
+fi
+
+hasstrings[name]=chars:16:hello
+hasstrings[digest]=hex:4:deadbeef
+sizeof -m buffer hasstrings
+pack $buffer hasstrings
+unset hasstrings
+struct -s hasstrings hasstrings
+unpack $buffer hasstrings
+dlcall free $buffer
+
+if test "${hasstrings[name]}"       != chars:16:hello   \
+ || test "${hasstrings[digest]}"    != hex:4:deadbeef; then
+    echo FAIL
+    exit 1
+else
+    echo PASS
+fi
+
 echo "Testing structs with embedded enums..."
 
 struct hasenum hasenum
@@ -0,0 +1,63 @@
+#!/bin/bash
+#
+# Test structures can be passed and returned by value.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+# Structures returned by value are unpacked into the layout.
+declare -a div_t=(int int)
+dlcall -r struct:div_t div int:7 int:2 || failure
+test "${div_t[0]}" == "int:3" || failure
+test "${div_t[1]}" == "int:1" || failure
+
+declare -a result=(long long)
+dlcall -r struct:ldiv_t=result ldiv long:-9 long:4 || failure
+test "${result[0]}" == "long:-2" || failure
+test "${result[1]}" == "long:-1" || failure
+
+# The layout is reused, so the previous values are replaced.
+dlcall -r struct:div_t div int:100 int:7 || failure
+test "${div_t[*]}" == "int:14 int:2" || failure
+
+# Structures passed by value are packed from the layout.
+declare -a addr=(uint8:127 uint8:0 uint8:0 uint8:1)
+dlcall -r pointer inet_ntoa struct:in_addr=addr || failure
+test "$(dlcall puts $DLRETVAL)" == "127.0.0.1" || failure
+
+# Sized members, e.g. from struct -s, are arrays of bytes.
+declare -a addr=(hex:4:7f000001)
+dlcall -r pointer inet_ntoa struct:in_addr=addr || failure
+test "$(dlcall puts $DLRETVAL)" == "127.0.0.1" || failure
+declare -a quotient=(chars:4 int)
+dlcall -r struct:div_t=quotient div int:65 int:1 || failure
+test "${quotient[*]}" == "chars:4:A int:0" || failure
+declare -a quotient=(hex:4 int)
+dlcall -r struct:div_t=quotient div int:258 int:1 || failure
+test "${quotient[*]}" == "hex:4:02010000 int:0" || failure
+addr=(hex:4:7f00000)
+dlcall inet_ntoa struct:in_addr=addr 2> /dev/null && failure
+
+# Results work with dlchain and asynchronous calls.
+dlchain -r struct:div_t div int:9 int:4 || failure
+test "${div_t[*]}" == "int:2 int:1" || failure
+
+dlcall -A job -r struct:div_t div int:11 int:3 || failure
+dlwait $job || failure
+test "${div_t[*]}" == "int:3 int:2" || failure
+
+# Bad layouts should fail without calling anything.
+declare -a empty=()
+dlcall -r struct:empty div int:1 int:1 2> /dev/null && failure
+declare -a broken=(int invalid)
+dlcall inet_ntoa struct:in_addr=broken 2> /dev/null && failure
+unset missing
+dlcall -r struct:missing=missing div int:1 int:1 2> /dev/null && failure
+
+echo PASS
@@ -0,0 +1,45 @@
+#!/bin/bash
+#
+# Test calls using specialized stubs match the generic libffi path.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+# Run a call with and without -F, and check both give the expected result.
+function check ()
+{
+    local expected=$1
+
+    shift
+
+    dlcall "$@" || failure
+    test "$DLRETVAL" == "$expected" || failure
+    dlcall -F "$@" || failure
+    test "$DLRETVAL" == "$expected" || failure
+}
+
+# Return values must be truncated and extended like libffi.
+check long:1234 -r long labs long:-1234
+check int:-5 -r int strtol string:-5 $NULL int:10
+check uint8:255 -r uint8 strtol string:-1 $NULL int:10
+check uint32:4294967295 -r uint32 strtol string:-1 $NULL int:10
+
+# Small parameters must be extended correctly.
+check int:1 -r int abs int8:-1
+check int:65535 -r int abs uint16:65535
+check long:42 -r long labs int64:-42
+
+# Six parameters is the most a stub handles, more use libffi.
+check int:3 -r int snprintf $NULL long:0 string:%d%d%d int:1 int:2 int:3
+check int:6 -r int snprintf $NULL long:0 string:%d%d%d%d%d%d int:1 int:2 int:3 int:4 int:5 int:6
+
+# Floating point always uses libffi.
+check double:2.500000 -r double strtod string:2.5 $NULL
+
+echo PASS
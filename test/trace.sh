@@ -0,0 +1,83 @@
+#!/bin/bash
+#
+# Test builtin invocations are recorded in the trace log.
+#
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+decode=../src/ctypes-trace
+log=$(mktemp)
+
+trap 'rm -f $log' EXIT
+
+# The log is only written if CTYPES_TRACE is set when ctypes.so is loaded.
+CTYPES_TRACE=$log bash -c '
+    source ctypes.sh
+
+    for ((i = 0; i < 3; i++)); do
+        dlcall -r long strlen string:hello
+    done
+
+    dlsym -n ptr strlen
+
+    function compare {
+        dlcall -r int abs int:-1
+        return 0
+    }
+
+    callback -n cmp compare int pointer pointer
+    dlcall -r pointer -n ptr calloc 2 4
+    dlcall qsort $ptr long:2 long:4 $cmp
+    dlcall free $ptr
+
+    dlbind -r int -n cabs abs int
+    cabs -1
+
+    dlcall -r int nosuchsymbol
+    exit 0
+' 2> /dev/null || failure
+
+test -s $log || failure
+
+$decode $log > $log.timeline || failure
+trap 'rm -f $log $log.timeline' EXIT
+
+# Every invocation has a line, in the order they started.
+grep -q "^ *start(us)" $log.timeline || failure
+test "$(grep -c " dlcall strlen (4 args) = 0$" $log.timeline)" -eq 3 || failure
+grep -q " dlsym strlen (3 args) = 0$" $log.timeline || failure
+grep -q " dlbind (6 args) = 0$" $log.timeline || failure
+grep -q " cabs (1 args) = 0$" $log.timeline || failure
+grep -q " dlcall nosuchsymbol (3 args) = 1$" $log.timeline || failure
+
+# Native calls made by a callback are nested within it.
+grep -A2 " dlcall qsort " $log.timeline | grep -q "^.* \{4\}callback compare (2 args) = 0$" || failure
+grep -A2 " dlcall qsort " $log.timeline | grep -q "^.* \{6\}dlcall abs (4 args) = 0$" || failure
+
+# A Chrome trace has an event for each line of the timeline.
+$decode -c $log > $log.timeline || failure
+head -1 $log.timeline | grep -q '^{"displayTimeUnit":"ns","traceEvents":\[$' || failure
+test "$(grep -c '"ph":"X"' $log.timeline)" -eq 13 || failure
+grep -q '^{"name":"strlen","cat":"dlcall","ph":"X",' $log.timeline || failure
+
+# Only the most recent invocations are kept.
+CTYPES_TRACE=$log CTYPES_TRACE_RECORDS=4 bash -c '
+    source ctypes.sh
+
+    for ((i = 0; i < 10; i++)); do
+        dlcall -r long strlen string:hello
+    done
+' > /dev/null || failure
+
+$decode $log 2> /dev/null > $log.timeline || failure
+test "$(grep -c " dlcall strlen " $log.timeline)" -eq 4 || failure
+$decode $log 2>&1 > /dev/null | grep -q "^ctypes-trace: 6 older records were overwritten$" || failure
+
+$decode /dev/null 2> /dev/null && failure
+$decode 2> /dev/null && failure
+
+echo PASS
@@ -0,0 +1,102 @@
+#!/bin/bash
+#
+# Test packing and unpacking NULL terminated vectors of strings.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+# The vector and strings are a single allocation.
+declare -a args=(first "second word" "" "string:literal" last)
+pack -z argv args || failure
+unpack -z $argv result || failure
+test ${#result[@]} -eq 5 || failure
+test "${result[1]}" == "second word" || failure
+test -z "${result[2]}" || failure
+test "${result[*]}" == "${args[*]}" || failure
+
+# Elements are plain char pointers.
+declare -a elements=(pointer pointer pointer pointer pointer pointer)
+unpack $argv elements || failure
+test "${elements[5]}" == "pointer:0" -o "${elements[5]}" == "pointer:(nil)" || failure
+dlcall -r long -n length strlen ${elements[3]} || failure
+test "$length" == "long:14" || failure
+dlcall free $argv
+
+# Sparse arrays are packed in order, without gaps.
+declare -a sparse=([3]=c [1]=a [2]=b [10]=d)
+pack -z argv sparse || failure
+unpack -z $argv result || failure
+test "${result[*]}" == "a b c d" || failure
+test "${!result[*]}" == "0 1 2 3" || failure
+dlcall free $argv
+
+# An empty array is just the terminator.
+declare -a empty=()
+pack -z argv empty || failure
+unpack -z $argv result || failure
+test ${#result[@]} -eq 0 || failure
+dlcall free $argv
+
+# Native vectors can be read directly.
+dlcall -r pointer -n vector calloc 3 8 || failure
+dlcall -r pointer -n dup strdup string:native || failure
+declare -a entries=($dup $dup)
+pack $vector entries || failure
+unpack -z $vector result || failure
+test "${result[*]}" == "native native" || failure
+dlcall free $dup
+dlcall free $vector
+
+# Within dlscope the vector is released with the scope.
+function scoped ()
+{
+    dlscope
+    pack -z argv args || return 1
+    unpack -z $argv result || return 1
+    test "${result[4]}" == "last"
+}
+
+scoped || failure
+
+# Vectors can be passed to native functions that expect argv.
+declare -a options=(prog -v -o file.txt input)
+pack -z optv options || failure
+dlsym -n optind optind || failure
+declare -a index=(int:1)
+pack $optind index || failure
+found=()
+while true; do
+    dlcall -r int -n c getopt int:${#options[@]} $optv string:vo: || failure
+    test "$c" == "int:-1" && break
+    found+=(${c##*:})
+    if test "$c" == "int:111"; then
+        dlsym -n optarg -d pointer optarg || failure
+        dlstr -n value $optarg || failure
+        test "$value" == "file.txt" || failure
+    fi
+done
+test "${found[*]}" == "118 111" || failure
+unpack $optind index || failure
+test "${options[${index##*:}]}" == "input" || failure
+dlcall free $optv
+
+# Only indexed arrays, and -z can't be combined with -N or -f.
+declare -A assoc=([a]=b)
+pack -z argv assoc 2> /dev/null && failure
+pack -z argv missing 2> /dev/null && failure
+pack -z argv 2> /dev/null && failure
+unpack -z 2> /dev/null && failure
+unpack -z int:1 result 2> /dev/null && failure
+unpack -z $NULL result 2> /dev/null && failure
+unpack $NULL args 2> /dev/null && failure
+pack $NULL args 2> /dev/null && failure
+pack -z -N 2 argv args 2> /dev/null && failure
+unpack -z -f a $argv result 2> /dev/null && failure
+
+echo PASS
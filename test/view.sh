@@ -0,0 +1,99 @@
+#!/bin/bash
+#
+# Test arrays backed by native memory.
+#
+
+source ctypes.sh
+
+function failure ()
+{
+    echo FAIL
+    exit 1
+}
+
+dlcall -r pointer -n data calloc 16 4 || failure
+dlview -t int32 -n 16 $data values || failure
+
+# Elements are read from native memory.
+test ${#values[@]} -eq 16 || failure
+test "${values[3]}" == "int32:0" || failure
+
+# Assignments are written to native memory, with or without a prefix.
+values[3]=42
+values[4]=int32:-7
+test "${values[3]}" == "int32:42" || failure
+test "${values[4]}" == "int32:-7" || failure
+declare -a check=(int32 int32 int32 int32 int32)
+unpack $data check || failure
+test "${check[3]}" == "int32:42" || failure
+test "${check[4]}" == "int32:-7" || failure
+
+# Native changes are visible after an update.
+check=(int32:1 int32:2 int32:3)
+pack $data check || failure
+test "${values[0]}" == "int32:0" || failure
+dlview -u values || failure
+test "${values[*]:0:5}" == "int32:1 int32:2 int32:3 int32:42 int32:-7" || failure
+dlcall memset $data 0 64 || failure
+dlview -u values || failure
+test "${values[3]}" == "int32:0" || failure
+
+# Compound assignments and unset elements are restored from native memory.
+values=(5 6)
+test "${values[1]}" == "int32:6" || failure
+dlview -u values || failure
+test ${#values[@]} -eq 16 || failure
+unset 'values[1]'
+dlview -u values || failure
+test "${values[1]}" == "int32:6" || failure
+
+# Elements can be used in loops and arithmetic.
+for ((i = 0; i < 16; i++)); do
+    values[i]=$((i * i))
+done
+total=0
+for value in "${values[@]}"; do
+    ((total += ${value##*:}))
+done
+test $total -eq 1240 || failure
+
+# Invalid assignments leave native memory unchanged.
+{ values[16]=1; } 2> /dev/null
+{ values[2]=notanumber; } 2> /dev/null
+{ values[2]=int:4; } 2> /dev/null
+test "${values[2]}" == "int32:4" || failure
+test ${#values[@]} -eq 16 || failure
+
+# Sized types are supported.
+dlview -t hex:4 -n 16 $data words || failure
+test "${words[1]}" == "hex:4:01000000" || failure
+words[1]=deadbeef
+dlview -u values || failure
+test "${values[1]}" == "int32:$((0xefbeadde - (1 << 32)))" || failure
+words[2]=hex:4:00000000
+dlview -u values || failure
+test "${values[2]}" == "int32:0" || failure
+
+# Views are removed with dlview -d, or unset.
+dlview -d words || failure
+test -z "${words[*]}" || failure
+dlview -d words 2> /dev/null && failure
+dlview -u words 2> /dev/null && failure
+dlview -u values extra 2> /dev/null && failure
+unset values
+dlview -t uint8 -n 4 $data values || failure
+test "${values[*]}" == "uint8:0 uint8:0 uint8:0 uint8:0" || failure
+unset values
+
+# Invalid parameters.
+dlview -t int32 -n 16 int:1 values 2> /dev/null && failure
+dlview -t void -n 16 $data values 2> /dev/null && failure
+dlview -t hex:4:00 -n 16 $data values 2> /dev/null && failure
+dlview -t int32 $data values 2> /dev/null && failure
+dlview -t int32 -n 0 $data values 2> /dev/null && failure
+dlview -n 16 $data values 2> /dev/null && failure
+dlview -t int32 -n 1 $data 1values 2> /dev/null && failure
+
+dlcall free $data
+
+echo PASS